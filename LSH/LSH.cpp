@@ -1,16 +1,40 @@
 #include <vector>
 #include <set>
+#include <utility> // std::pair, std::make_pair
+#include <algorithm> // std::sort, std::nth_element, std::unique
+#include <random>
+#include <chrono>
 #include "LSH.h"
 #include "../metrics.h"
 #include "../data_point.h"
 #include "cosine_hash_table.h"
+#include "../matrix.h"
 
-LSH::LSH(int k, int dimensions, int L2, int n)
-	: L(L2) {
+LSH::LSH(int k2, int d, int L2, int n, unsigned int signatureBits, unsigned int rerankArg, bool structuredArg)
+	: k(k2), dimensions(d), L(L2), structured(structuredArg), signatureWords((signatureBits + 63) / 64), rerankSize(rerankArg) {
 	// Create L hash tables
 	int i;
 	for (i = 0; i < L; i++) {
-		tables.push_back(new CosineHashTable(k, dimensions));
+		CosineHashTable *table = new CosineHashTable(k, dimensions, structured);
+		tables.push_back(table);
+
+		// Append the r_i vectors of the table to the stacked matrix
+		const std::vector< std::vector<double> >& r = table->getHyperplanes();
+		for (unsigned int j = 0; j < r.size(); j++) {
+			hyperplanes.insert(hyperplanes.end(), r[j].begin(), r[j].end());
+		}
+	}
+
+	// Create the random vectors of the signature bits using normal distribution
+	if (signatureWords > 0) {
+		unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count();
+		std::default_random_engine generator(seed);
+		std::normal_distribution<double> distrib(0.0, 1.0); // N(0,1)
+
+		signatureHyperplanes.resize(64 * signatureWords * dimensions);
+		for (unsigned int j = 0; j < signatureHyperplanes.size(); j++) {
+			signatureHyperplanes[j] = distrib(generator);
+		}
 	}
 }
 
@@ -21,6 +45,94 @@ void LSH::insert(DataPoint& p) {
 	for (i = 0; i < L; i++) {
 		tables[i]->insert(p);
 	}
+
+	// Save the signature of the point
+	if (signatureWords > 0 && p.getDimensions() == (unsigned int) dimensions) {
+		signatureIndex[&p] = signaturePoints.size();
+		signaturePoints.push_back(&p);
+		signatures.resize(signatures.size() + signatureWords);
+		computeSignature(p, &signatures[signatures.size() - signatureWords]);
+	}
+}
+
+
+/* Rehash a point whose coordinates changed in every table */
+void LSH::update(DataPoint& p) {
+	int i;
+	for (i = 0; i < L; i++) {
+		tables[i]->update(p);
+	}
+
+	if (signatureWords > 0) {
+		std::unordered_map<const DataPoint *, unsigned int>::const_iterator found = signatureIndex.find(&p);
+		if (found != signatureIndex.end()) {
+			computeSignature(p, &signatures[(unsigned long long) found->second * signatureWords]);
+		}
+	}
+}
+
+
+/* Compute the sign signature of a point (one bit per signature vector) */
+void LSH::computeSignature(const DataPoint& p, unsigned long long *signature) const {
+	std::vector<double> projections(64 * signatureWords);
+	multiplyTransposed(p.getData(), 1, &signatureHyperplanes[0], projections.size(), dimensions, &projections[0]);
+	projectionsToSignature(&projections[0], signature);
+}
+
+
+void LSH::projectionsToSignature(const double *projections, unsigned long long *signature) const {
+	for (unsigned int w = 0; w < signatureWords; w++) {
+		unsigned long long word = 0;
+		for (unsigned int b = 0; b < 64; b++) {
+			if (projections[w * 64 + b] >= 0) {
+				word |= (1ULL << b);
+			}
+		}
+		signature[w] = word;
+	}
+}
+
+
+/* Keep the candidates with the closest signatures to the query (Hamming distance)
+ * and compute the cosine distance only for them. Return the index of the closest */
+int LSH::rerankCandidates(const DataPoint& q, const unsigned long long *querySignature, const std::vector<DataPoint *>& candidates, std::vector<DataPoint *>& results, std::vector<double>& distances) const {
+	// Get every candidate once (the same point may be found in many tables)
+	std::vector<unsigned int> indices;
+	for (unsigned int i = 0; i < candidates.size(); i++) {
+		indices.push_back(signatureIndex.at(candidates[i]));
+	}
+	std::sort(indices.begin(), indices.end());
+	indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+	std::vector< std::pair<unsigned int, unsigned int> > hammingAndIndices;
+	for (unsigned int i = 0; i < indices.size(); i++) {
+		const unsigned long long *signature = &signatures[(unsigned long long) indices[i] * signatureWords];
+		unsigned int hamming = 0;
+		for (unsigned int w = 0; w < signatureWords; w++) {
+			hamming += __builtin_popcountll(signature[w] ^ querySignature[w]);
+		}
+		hammingAndIndices.push_back(std::make_pair(hamming, indices[i]));
+	}
+
+	if (rerankSize > 0 && hammingAndIndices.size() > rerankSize) {
+		std::nth_element(hammingAndIndices.begin(), hammingAndIndices.begin() + rerankSize, hammingAndIndices.end());
+		hammingAndIndices.resize(rerankSize);
+	}
+
+	double minDist = -1.0;
+	int minIndex = -1;
+	for (unsigned int i = 0; i < hammingAndIndices.size(); i++) {
+		DataPoint *p = signaturePoints[hammingAndIndices[i].second];
+		double dist = Metrics::cosineDistance(q, *p);
+		results.push_back(p);
+		distances.push_back(dist);
+		if (dist < minDist || minIndex < 0) {
+			minDist = dist;
+			minIndex = results.size() - 1;
+		}
+	}
+
+	return minIndex;
 }
 
 
@@ -33,42 +145,193 @@ int LSH::findAllNeighbors(const DataPoint& q, std::vector<DataPoint *>& results,
 	double minDist = -1.0;
 	int minIndex = -1;
 
+	// Rank the candidates of every table by their signatures
+	if (signatureWords > 0) {
+		if (q.getDimensions() != (unsigned int) dimensions) {
+			return -1;
+		}
+
+		std::vector<DataPoint *> candidates;
+		std::vector<int> g;
+		for (i = 0; i < L; i++) {
+			tables[i]->computeG(q, g);
+			tables[i]->findCandidates(g, candidates);
+		}
+
+		std::vector<unsigned long long> querySignature(signatureWords);
+		computeSignature(q, &querySignature[0]);
+		return rerankCandidates(q, &querySignature[0], candidates, results, distances);
+	}
+
 	// Find the neighbors of q in every hash table
 	for (i = 0; i < L; i++) {
 		std::vector<DataPoint *> neighbors;
 		std::vector<double> tempDistances;
 		int tempMinIndex = tables[i]->findNeighbors(q, neighbors, tempDistances);
+		mergeNeighbors(neighbors, tempDistances, tempMinIndex, alreadyFound, results, distances, minDist, minIndex);
+	}
 
-		// No neighbors found
-		if (tempMinIndex < 0) {
-			continue;
+	return minIndex;
+}
+
+
+/* Add the neighbors found in one hash table to the overall results */
+void LSH::mergeNeighbors(const std::vector<DataPoint *>& neighbors, const std::vector<double>& tempDistances, int tempMinIndex, std::set<std::string>& alreadyFound,
+		std::vector<DataPoint *>& results, std::vector<double>& distances, double& minDist, int& minIndex) const {
+	// No neighbors found
+	if (tempMinIndex < 0) {
+		return;
+	}
+
+	DataPoint *tempMin = neighbors[tempMinIndex];
+	double tempDist = tempDistances[tempMinIndex];
+	// Check if local minimum is overall minimum
+	if (tempDist < minDist || minIndex < 0) {
+		minDist = tempDist;
+
+		// Since we got a new minimum, the data point is new
+		alreadyFound.insert(tempMin->getID());
+
+		results.push_back(tempMin);
+		distances.push_back(tempDist);
+		minIndex = results.size() - 1;
+	}
+
+	// Store the points that haven't already been found
+	unsigned int j;
+	for (j = 0; j < neighbors.size(); j++) {
+		if (alreadyFound.insert(neighbors[j]->getID()).second != false) { // new
+			results.push_back(neighbors[j]);
+			distances.push_back(tempDistances[j]);
 		}
+	}
+}
 
-		DataPoint *tempMin = neighbors[tempMinIndex];
-		double tempDist = tempDistances[tempMinIndex];
-		// Check if local minimum is overall minimum
-		if (tempDist < minDist || minIndex < 0) {
-			minDist = tempDist;
 
-			// Since we got a new minimum, the data point is new
-			alreadyFound.insert(tempMin->getID());
+/* Find all neighbors of a batch of queries. The queries are hashed in blocks
+ * by multiplying them with the stacked r_i vectors of every table at once and
+ * then the buckets of each table are scanned as in findAllNeighbors
+ * (Structured tables hash every query with their own transforms) */
+void LSH::findAllNeighborsBatch(const std::vector<const DataPoint *>& queries, std::vector< std::vector<DataPoint *> >& results,
+		std::vector< std::vector<double> >& distances, std::vector<int>& minIndices) const {
+	results.clear();
+	distances.clear();
+	minIndices.clear();
+	results.resize(queries.size());
+	distances.resize(queries.size());
+	minIndices.resize(queries.size(), -1);
 
-			results.push_back(tempMin);
-			distances.push_back(tempDist);
-			minIndex = results.size() - 1;
+	unsigned int projections = structured ? 0 : L * k;
+	unsigned int signatureBits = 64 * signatureWords;
+	std::vector<double> block(BATCH_BLOCK_SIZE * dimensions);
+	std::vector<double> products(BATCH_BLOCK_SIZE * projections);
+	std::vector<double> signatureProducts(BATCH_BLOCK_SIZE * signatureBits);
+	std::vector<unsigned long long> querySignature(signatureWords);
+
+	for (unsigned int start = 0; start < queries.size(); start += BATCH_BLOCK_SIZE) {
+		unsigned int end = (start + BATCH_BLOCK_SIZE < queries.size()) ? start + BATCH_BLOCK_SIZE : queries.size();
+
+		// Pack the block of queries in a contiguous matrix
+		for (unsigned int b = start; b < end; b++) {
+			if (queries[b]->getDimensions() != (unsigned int) dimensions) {
+				continue;
+			}
+			for (int j = 0; j < dimensions; j++) {
+				block[(b - start) * dimensions + j] = queries[b]->at(j);
+			}
+		}
+
+		// Every projection of every query of the block
+		if (!structured) {
+			multiplyTransposed(&block[0], end - start, &hyperplanes[0], projections, dimensions, &products[0]);
 		}
+		if (signatureWords > 0) {
+			multiplyTransposed(&block[0], end - start, &signatureHyperplanes[0], signatureBits, dimensions, &signatureProducts[0]);
+		}
+
+		for (unsigned int b = start; b < end; b++) {
+			// Query with mismatching dimensions has no neighbors
+			if (queries[b]->getDimensions() != (unsigned int) dimensions) {
+				continue;
+			}
+
+			std::set<std::string> alreadyFound;
+			double minDist = -1.0;
+			int minIndex = -1;
+			const double *queryProducts = structured ? NULL : &products[(b - start) * projections];
+
+			std::vector<int> g(k);
+			std::vector<DataPoint *> candidates;
+			for (int i = 0; i < L; i++) {
+				if (structured) {
+					tables[i]->computeG(*queries[b], g);
+				} else {
+					// Same as h_i of the cosine hash table
+					for (int j = 0; j < k; j++) {
+						g[j] = (queryProducts[i * k + j] >= 0) ? 1 : 0;
+					}
+				}
+
+				if (signatureWords > 0) {
+					tables[i]->findCandidates(g, candidates);
+					continue;
+				}
 
-		// Store the points that haven't already been found
-		unsigned int j;
-		for (j = 0; j < neighbors.size(); j++) {
-			if (alreadyFound.insert(neighbors[j]->getID()).second != false) { // new
-				results.push_back(neighbors[j]);
-				distances.push_back(tempDistances[j]);
+				std::vector<DataPoint *> neighbors;
+				std::vector<double> tempDistances;
+				int tempMinIndex = tables[i]->findNeighbors(*queries[b], g, neighbors, tempDistances);
+				mergeNeighbors(neighbors, tempDistances, tempMinIndex, alreadyFound, results[b], distances[b], minDist, minIndex);
 			}
+
+			if (signatureWords > 0) {
+				projectionsToSignature(&signatureProducts[(b - start) * signatureBits], &querySignature[0]);
+				minIndex = rerankCandidates(*queries[b], &querySignature[0], candidates, results[b], distances[b]);
+			}
+
+			minIndices[b] = minIndex;
 		}
 	}
+}
 
-	return minIndex;
+
+/* Find the K nearest of the neighbors found in the L hash tables */
+void LSH::findNearestNeighbors(const DataPoint& q, unsigned int K, std::vector<DataPoint *>& results, std::vector<double>& distances) const {
+	std::vector<DataPoint *> neighbors;
+	std::vector<double> neighborDistances;
+	findAllNeighbors(q, neighbors, neighborDistances);
+	keepClosest(neighbors, neighborDistances, K);
+
+	results.insert(results.end(), neighbors.begin(), neighbors.end());
+	distances.insert(distances.end(), neighborDistances.begin(), neighborDistances.end());
+}
+
+
+void LSH::findNearestNeighborsBatch(const std::vector<const DataPoint *>& queries, unsigned int K, std::vector< std::vector<DataPoint *> >& results, std::vector< std::vector<double> >& distances) const {
+	std::vector<int> minIndices;
+	findAllNeighborsBatch(queries, results, distances, minIndices);
+	for (unsigned int i = 0; i < queries.size(); i++) {
+		keepClosest(results[i], distances[i], K);
+	}
+}
+
+
+/* Sort the neighbors by distance and keep only the K closest */
+void LSH::keepClosest(std::vector<DataPoint *>& neighbors, std::vector<double>& distances, unsigned int K) const {
+	std::vector< std::pair<double, unsigned int> > distancesAndIndices;
+	for (unsigned int i = 0; i < distances.size(); i++) {
+		distancesAndIndices.push_back(std::make_pair(distances[i], i));
+	}
+	std::sort(distancesAndIndices.begin(), distancesAndIndices.end());
+
+	std::vector<DataPoint *> closest;
+	std::vector<double> closestDistances;
+	for (unsigned int i = 0; i < distancesAndIndices.size() && i < K; i++) {
+		closest.push_back(neighbors[distancesAndIndices[i].second]);
+		closestDistances.push_back(distancesAndIndices[i].first);
+	}
+
+	neighbors.swap(closest);
+	distances.swap(closestDistances);
 }
 
 
@@ -103,9 +366,19 @@ double LSH::findNearestNeighbor(const DataPoint& q, DataPoint& min) const {
 
 unsigned long long LSH::getSize() const {
 	unsigned long long total = 0;
+	total += sizeof(k);
+	total += sizeof(dimensions);
 	total += sizeof(L);
 	total += sizeof(tables);
 	total += L * sizeof(HashTable *);
+	total += sizeof(hyperplanes);
+	total += hyperplanes.size() * sizeof(double);
+	total += sizeof(signatureWords);
+	total += sizeof(rerankSize);
+	total += signatureHyperplanes.size() * sizeof(double);
+	total += signatures.size() * sizeof(unsigned long long);
+	total += signaturePoints.size() * sizeof(DataPoint *);
+	total += signatureIndex.bucket_count() * sizeof(void *) + signatureIndex.size() * (sizeof(const DataPoint *) + sizeof(unsigned int));
 	int i;
 	for (i = 0; i < L; i++) {
 		total += tables[i]->getSize();
@@ -114,6 +387,26 @@ unsigned long long LSH::getSize() const {
 }
 
 
+/* Copy of the tables and the signatures of another LSH (only the points move to the copy of the vector) */
+LSH::LSH(const LSH& other, const std::vector<DataPoint>& from, std::vector<DataPoint>& to)
+	: k(other.k), dimensions(other.dimensions), L(other.L), hyperplanes(other.hyperplanes), structured(other.structured),
+	  signatureWords(other.signatureWords), rerankSize(other.rerankSize), signatureHyperplanes(other.signatureHyperplanes), signatures(other.signatures) {
+	for (int i = 0; i < L; i++) {
+		tables.push_back(other.tables[i]->copy(from, to));
+	}
+	for (unsigned int i = 0; i < other.signaturePoints.size(); i++) {
+		DataPoint *p = movePoint(other.signaturePoints[i], from, to);
+		signatureIndex[p] = i;
+		signaturePoints.push_back(p);
+	}
+}
+
+
+NeighborSearch *LSH::copy(const std::vector<DataPoint>& from, std::vector<DataPoint>& to) const {
+	return new LSH(*this, from, to);
+}
+
+
 LSH::~LSH() {
 	int i;
 	for (i = 0; i < L; i++) {
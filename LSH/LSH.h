@@ -2,23 +2,63 @@
 #define LSH_H
 
 #include <vector>
+#include <set>
+#include <string>
+#include <unordered_map>
 #include "hash_table.h"
 #include "../data_point.h"
+#include "../neighbor_search.h"
 
-class LSH {
+class LSH: public NeighborSearch {
 protected:
+	// Number of queries hashed together by a batched query
+	static const unsigned int BATCH_BLOCK_SIZE = 64;
+
+	int k; // Number of h_i functions per table
+	int dimensions;
 	int L; // Number of Hash Tables
 
 	// L hash tables;
 	std::vector<HashTable *> tables;
+
+	// The r_i vectors of every table stacked in one (L * k) x dimensions row-major matrix
+	// (Used to hash a block of queries with a single matrix multiplication)
+	std::vector<double> hyperplanes;
+	// Tables hashing with Hadamard transforms instead of r_i vectors (no stacked matrix)
+	bool structured;
+
+	// Longer sign signatures of the points used to rank the candidates by Hamming
+	// distance so that the cosine distance is computed only for the best ones
+	// (Disabled if signatureWords is 0)
+	unsigned int signatureWords; // 64 bit words per signature
+	unsigned int rerankSize; // Candidates kept for the cosine distance
+	std::vector<double> signatureHyperplanes; // (64 * signatureWords) x dimensions row-major
+	std::vector<unsigned long long> signatures; // signatureWords per inserted point
+	std::vector<DataPoint *> signaturePoints;
+	std::unordered_map<const DataPoint *, unsigned int> signatureIndex;
+
+
+	void computeSignature(const DataPoint&, unsigned long long *) const;
+	void projectionsToSignature(const double *, unsigned long long *) const;
+	int rerankCandidates(const DataPoint&, const unsigned long long *, const std::vector<DataPoint *>&, std::vector<DataPoint *>&, std::vector<double>&) const;
+	void mergeNeighbors(const std::vector<DataPoint *>&, const std::vector<double>&, int, std::set<std::string>&, std::vector<DataPoint *>&, std::vector<double>&, double&, int&) const;
+	void keepClosest(std::vector<DataPoint *>&, std::vector<double>&, unsigned int) const;
+
+	LSH(const LSH&, const std::vector<DataPoint>&, std::vector<DataPoint>&);
 public:
-	LSH(int, int, int, int);
+	LSH(int, int, int, int, unsigned int signatureBits = 0, unsigned int rerankArg = 0, bool structuredArg = false);
 
 	void insert(DataPoint&);
+	void update(DataPoint&);
 	int findAllNeighbors(const DataPoint&, std::vector<DataPoint *>&, std::vector<double>&) const;
+	void findAllNeighborsBatch(const std::vector<const DataPoint *>&, std::vector< std::vector<DataPoint *> >&, std::vector< std::vector<double> >&, std::vector<int>&) const;
 	double findNearestNeighbor(const DataPoint&, DataPoint&) const;
 
+	void findNearestNeighbors(const DataPoint&, unsigned int, std::vector<DataPoint *>&, std::vector<double>&) const;
+	void findNearestNeighborsBatch(const std::vector<const DataPoint *>&, unsigned int, std::vector< std::vector<DataPoint *> >&, std::vector< std::vector<double> >&) const;
+
 	unsigned long long getSize() const;
+	NeighborSearch *copy(const std::vector<DataPoint>&, std::vector<DataPoint>&) const;
 
 	~LSH();
 };
@@ -5,14 +5,34 @@
 #include "cosine_hash_table.h"
 #include "../data_point.h"
 #include "../metrics.h"
+#include "../matrix.h"
 #include "../util.h"
 
-CosineHashTable::CosineHashTable(int k, int dimensions)
-	: HashTable(k, dimensions, &Metrics::cosineDistance) {
+CosineHashTable::CosineHashTable(int k, int dimensions, bool structuredArg)
+	: HashTable(k, dimensions, &Metrics::cosineDistance), structured(structuredArg), paddedDimensions(0) {
 	// Initialize the seed for the random number generator
 	unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count();
 	std::default_random_engine generator(seed);
 
+	if (structured) {
+		// Pad the dimensions to a power of 2 (at least k to get k coordinates)
+		paddedDimensions = 1;
+		while (paddedDimensions < (unsigned int) dimensions || paddedDimensions < (unsigned int) k) {
+			paddedDimensions *= 2;
+		}
+
+		// Create the random sign flips
+		std::bernoulli_distribution coin(0.5);
+		for (unsigned int i = 0; i < HADAMARD_ROUNDS; i++) {
+			std::vector<double> newSigns;
+			for (unsigned int j = 0; j < paddedDimensions; j++) {
+				newSigns.push_back(coin(generator) ? 1.0 : -1.0);
+			}
+			signs.push_back(newSigns);
+		}
+		return;
+	}
+
 	std::normal_distribution<double> distrib(0.0, 1.0); // N(0,1)
 
 	// Create k random r_i vectors using normal distribution
@@ -28,13 +48,78 @@ CosineHashTable::CosineHashTable(int k, int dimensions)
 }
 
 
+/* In structured mode every h_i comes from the same transform, so the g function
+ * is computed once (computeG doesn't call h in this mode) */
 int CosineHashTable::h(const DataPoint& p, int i) const {
+	if (structured) {
+		std::vector<int> g;
+		computeG(p, g);
+		return g[i];
+	}
+
 	double prod = p.dotProduct(r[i]);
 	return (prod >= 0) ? 1 : 0;
 }
 
 
+/* Compute every h_i with one transform in structured mode */
+void CosineHashTable::computeG(const DataPoint& p, std::vector<int>& g) const {
+	if (!structured) {
+		HashTable::computeG(p, g);
+		return;
+	}
+
+	std::vector<double> projections;
+	structuredProjections(p, projections);
+
+	g.clear();
+	int i;
+	for (i = 0; i < k; i++) {
+		g.push_back((projections[i] >= 0) ? 1 : 0);
+	}
+}
+
+
+/* Apply the random sign flips and Hadamard transforms to the zero padded point */
+void CosineHashTable::structuredProjections(const DataPoint& p, std::vector<double>& projections) const {
+	projections.assign(paddedDimensions, 0.0);
+	for (unsigned int j = 0; j < p.getDimensions() && j < paddedDimensions; j++) {
+		projections[j] = p.at(j);
+	}
+
+	for (unsigned int i = 0; i < HADAMARD_ROUNDS; i++) {
+		for (unsigned int j = 0; j < paddedDimensions; j++) {
+			projections[j] *= signs[i][j];
+		}
+		fastWalshHadamard(&projections[0], paddedDimensions);
+	}
+}
+
+
 /* Convert the binary sequence g to an integer used for the hash table indexes */
 unsigned int CosineHashTable::gToBucket(const std::vector<int>& g) const {
 	return binToDec(g);
 }
+
+
+unsigned long long CosineHashTable::getSize() const {
+	unsigned long long total = HashTable::getSize();
+	total += sizeof(r);
+	for (unsigned int i = 0; i < r.size(); i++) {
+		total += r[i].size() * sizeof(double);
+	}
+	total += sizeof(structured);
+	total += sizeof(paddedDimensions);
+	total += sizeof(signs);
+	for (unsigned int i = 0; i < signs.size(); i++) {
+		total += signs[i].size() * sizeof(double);
+	}
+	return total;
+}
+
+
+HashTable *CosineHashTable::copy(const std::vector<DataPoint>& from, std::vector<DataPoint>& to) const {
+	CosineHashTable *result = new CosineHashTable(*this);
+	result->movePoints(from, to);
+	return result;
+}
@@ -7,13 +7,31 @@
 
 class CosineHashTable: public HashTable {
 private:
+	static const unsigned int HADAMARD_ROUNDS = 3;
+
 	std::vector< std::vector<double> > r; // r_i, each one for a hyperplane
 
+	// Structured mode: the h_i are the signs of the first k coordinates of
+	// H * S_3 * H * S_2 * H * S_1 * x, where H is the Walsh-Hadamard transform
+	// and S_j are random sign flips (no r_i vectors are stored)
+	bool structured;
+	unsigned int paddedDimensions; // Power of 2 used by the Hadamard transform
+	std::vector< std::vector<double> > signs; // S_j
+
 
 	unsigned int gToBucket(const std::vector<int>&) const;
 	int h(const DataPoint&, int) const; // h_i
+	void structuredProjections(const DataPoint&, std::vector<double>&) const;
 public:
-	CosineHashTable(int, int);
+	CosineHashTable(int, int, bool structuredArg = false);
+
+	void computeG(const DataPoint&, std::vector<int>&) const;
+
+	bool isStructured() const { return structured; }
+	const std::vector< std::vector<double> >& getHyperplanes() const { return r; }
+
+	unsigned long long getSize() const;
+	HashTable *copy(const std::vector<DataPoint>&, std::vector<DataPoint>&) const;
 };
 
 #endif // COSINE_HASH_TABLE_H
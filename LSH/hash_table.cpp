@@ -1,4 +1,5 @@
 #include <vector>
+#include <algorithm> // std::remove
 #include "hash_table.h"
 #include "../data_point.h"
 
@@ -10,10 +11,7 @@ void HashTable::insert(DataPoint& p) {
 
 	// Create g function consisting of every h_i
 	std::vector<int> g;
-	int i;
-	for (i = 0; i < k; i++) {
-		g.push_back(h(p, i));
-	}
+	computeG(p, g);
 
 	int index = gToBucket(g);
 
@@ -25,23 +23,55 @@ void HashTable::insert(DataPoint& p) {
 }
 
 
+/* Move an inserted point to the bucket of its new coordinates */
+void HashTable::update(DataPoint& p) {
+	std::unordered_map<std::string, std::vector<int> >::iterator saved = saved_g.find(p.getID());
+	if (saved == saved_g.end()) { // Not inserted
+		return;
+	}
+
+	std::vector<DataPoint *>& oldBucket = buckets[gToBucket(saved->second)];
+	oldBucket.erase(std::remove(oldBucket.begin(), oldBucket.end(), &p), oldBucket.end());
+
+	std::vector<int> g;
+	computeG(p, g);
+	buckets[gToBucket(g)].push_back(&p);
+	saved->second = g;
+}
+
+
+/* Compute the g function (every h_i) of the given point */
+void HashTable::computeG(const DataPoint& p, std::vector<int>& g) const {
+	g.clear();
+	int i;
+	for (i = 0; i < k; i++) {
+		g.push_back(h(p, i));
+	}
+}
+
+
 /* Find the neighbors of the given point and return them along with the closest neigbor index */
 int HashTable::findNeighbors(const DataPoint& q, std::vector<DataPoint *>& result, std::vector<double>& distances) const {
 	// Find the bucket of the query point
 	std::vector<int> g;
-	int j;
-	for (j = 0; j < k; j++) {
-		g.push_back(h(q, j));
-	}
+	computeG(q, g);
+
+	return findNeighbors(q, g, result, distances);
+}
 
+
+/* Find the neighbors of the given point using its already computed g function
+ * (Used by batched queries which compute the g functions of many points at once) */
+int HashTable::findNeighbors(const DataPoint& q, const std::vector<int>& g, std::vector<DataPoint *>& result, std::vector<double>& distances) const {
 	int index = gToBucket(g);
 
 	// Key doesn't exist (no neighbors)
-	if (buckets.find(index) == buckets.end()) {
+	std::unordered_map<int, std::vector<DataPoint *> >::const_iterator bucket = buckets.find(index);
+	if (bucket == buckets.end()) {
 		return -1;
 	}
 
-	std::vector<DataPoint *> neighbors = buckets.at(index);
+	const std::vector<DataPoint *>& neighbors = bucket->second;
 	double minDist = -1.0;
 	int minIndex = -1;
 
@@ -67,14 +97,31 @@ int HashTable::findNeighbors(const DataPoint& q, std::vector<DataPoint *>& resul
 }
 
 
+/* Find the points with the given g function without computing their distances */
+void HashTable::findCandidates(const std::vector<int>& g, std::vector<DataPoint *>& result) const {
+	int index = gToBucket(g);
+
+	// Key doesn't exist (no neighbors)
+	std::unordered_map<int, std::vector<DataPoint *> >::const_iterator bucket = buckets.find(index);
+	if (bucket == buckets.end()) {
+		return;
+	}
+
+	const std::vector<DataPoint *>& neighbors = bucket->second;
+	for (unsigned int i = 0; i < neighbors.size(); i++) {
+		// Check if the points have the same g function
+		if (g == saved_g.at(neighbors[i]->getID())) {
+			result.push_back(neighbors[i]);
+		}
+	}
+}
+
+
 /* Find the nearest neighbor of the given point and return the distance */
 double HashTable::findNearest(const DataPoint& q, DataPoint& min) const {
 	// Find the bucket of the query point
 	std::vector<int> g;
-	int j;
-	for (j = 0; j < k; j++) {
-		g.push_back(h(q, j));
-	}
+	computeG(q, g);
 
 	int index = gToBucket(g);
 
@@ -145,3 +192,13 @@ unsigned long long HashTable::getSize() const {
 
 	return total;
 }
+
+
+/* Move the points of the buckets from the elements of a vector to the same elements of a copy of it */
+void HashTable::movePoints(const std::vector<DataPoint>& from, std::vector<DataPoint>& to) {
+	for (auto& bucket : buckets) {
+		for (unsigned int i = 0; i < bucket.second.size(); i++) {
+			bucket.second[i] = &to[0] + (bucket.second[i] - &from[0]);
+		}
+	}
+}
@@ -24,14 +24,21 @@ protected:
 
 	virtual unsigned int gToBucket(const std::vector<int>&) const = 0; // Convert g to an index for a bucket
 	virtual int h(const DataPoint&, int) const = 0; // h_i
+	void movePoints(const std::vector<DataPoint>&, std::vector<DataPoint>&);
 public:
 	HashTable(int k2, int d, DIST_PTR metric) : k(k2), dimensions(d), dist(metric) {}
 
 	void insert(DataPoint&);
+	void update(DataPoint&);
+	virtual void computeG(const DataPoint&, std::vector<int>&) const;
 	int findNeighbors(const DataPoint&, std::vector<DataPoint *>&, std::vector<double>&) const;
+	int findNeighbors(const DataPoint&, const std::vector<int>&, std::vector<DataPoint *>&, std::vector<double>&) const;
+	void findCandidates(const std::vector<int>&, std::vector<DataPoint *>&) const;
 	double findNearest(const DataPoint&, DataPoint&) const;
 
 	virtual unsigned long long getSize() const;
+	// Copy of the table with the same elements of a copy of the vector of the inserted points
+	virtual HashTable *copy(const std::vector<DataPoint>&, std::vector<DataPoint>&) const = 0;
 
 	virtual ~HashTable() {}
 };
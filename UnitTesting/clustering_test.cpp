@@ -0,0 +1,295 @@
+#include <vector>
+#include <string>
+#include <random>
+#include <cmath>
+#include <fstream>
+#include <cstdio> // remove
+#include <set>
+#include "clustering_test.h"
+#include "../clustering.h"
+#include "../streaming_kmeans.h"
+#include "../data_point.h"
+#include "../metrics.h"
+#include <cppunit/extensions/HelperMacros.h>
+
+// Points around k centers (the same points for the same seed)
+static void createBlobs(std::vector<DataPoint>& points, unsigned int n, unsigned int k, unsigned int d, unsigned int seed) {
+	std::default_random_engine generator(seed);
+	std::normal_distribution<double> noise(0.0, 1.0);
+	std::uniform_real_distribution<double> center(-20.0, 20.0);
+
+	std::vector< std::vector<double> > centers(k, std::vector<double>(d));
+	for (unsigned int j = 0; j < k; j++) {
+		for (unsigned int t = 0; t < d; t++) {
+			centers[j][t] = center(generator);
+		}
+	}
+	for (unsigned int i = 0; i < n; i++) {
+		std::vector<double> coordinates(d);
+		for (unsigned int t = 0; t < d; t++) {
+			coordinates[t] = centers[i % k][t] + noise(generator);
+		}
+		points.push_back(DataPoint(coordinates, std::to_string(i)));
+	}
+}
+
+
+
+void ClusteringTest::testAssignment(void) {
+	std::vector<DataPoint> points;
+	createBlobs(points, 600, 6, 5, 1);
+
+	// Plain, parallel and bounded (Hamerly) assignment from the same k-means++ centroids
+	std::vector<int> assignments[4];
+	std::vector<DataPoint> centroids[4];
+	for (unsigned int run = 0; run < 4; run++) {
+		KMeansClustering *kMeans = (run >= 2) ? new BoundedKMeans(points, 6) : new KMeansClustering(points, 6);
+		kMeans->setInitialization(KMeansClustering::KMEANS_PP_INIT);
+		kMeans->setSeed(5);
+		kMeans->setThreads((run % 2 == 0) ? 1 : 4);
+		kMeans->run();
+		kMeans->getAssignments(assignments[run]);
+		std::vector<DataPoint *> runCentroids = kMeans->getCentroids();
+		for (unsigned int j = 0; j < runCentroids.size(); j++) {
+			centroids[run].push_back(*runCentroids[j]);
+		}
+		delete kMeans;
+
+		CPPUNIT_ASSERT( assignments[run] == assignments[0] );
+		for (unsigned int j = 0; j < centroids[run].size(); j++) {
+			for (unsigned int t = 0; t < 5; t++) {
+				CPPUNIT_ASSERT_DOUBLES_EQUAL( centroids[0][j].at(t), centroids[run][j].at(t), 0.000000001 );
+			}
+		}
+	}
+}
+
+
+
+void ClusteringTest::testSampledSilhouette(void) {
+	std::vector<DataPoint> points;
+	createBlobs(points, 300, 4, 3, 2);
+	KMeansClustering kMeans(points, 4);
+	kMeans.setInitialization(KMeansClustering::KMEANS_PP_INIT);
+	// Same clustering in every run (k-means++ may merge two blobs for other seeds)
+	kMeans.setSeed(3);
+	kMeans.run();
+
+	std::vector<double> exact;
+	double exactAverage = kMeans.silhouette(exact);
+	CPPUNIT_ASSERT( exactAverage > 0.5 && exactAverage <= 1.0 );
+
+	// A sample of every point is the exact silhouette
+	for (unsigned int sampleSize = points.size(); sampleSize <= points.size() + 100; sampleSize += 100) {
+		std::vector<double> sampled;
+		CPPUNIT_ASSERT_DOUBLES_EQUAL( exactAverage, kMeans.sampledSilhouette(sampled, sampleSize), 0.000000001 );
+		CPPUNIT_ASSERT( sampled.size() == exact.size() );
+		for (unsigned int j = 0; j < exact.size(); j++) {
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( exact[j], sampled[j], 0.000000001 );
+		}
+	}
+
+	// A smaller sample is close to it for well separated clusters
+	std::vector<double> sampled;
+	CPPUNIT_ASSERT_DOUBLES_EQUAL( exactAverage, kMeans.sampledSilhouette(sampled, 150), 0.1 );
+}
+
+
+
+void ClusteringTest::testWarmStart(void) {
+	std::vector<DataPoint> points;
+	createBlobs(points, 400, 5, 4, 3);
+	KMeansClustering kMeans(points, 5);
+	kMeans.setInitialization(KMeansClustering::KMEANS_PP_INIT);
+	kMeans.run();
+
+	std::vector<int> assignments;
+	kMeans.getAssignments(assignments);
+	std::vector<DataPoint *> centroids = kMeans.getCentroids();
+	std::vector<DataPoint> startCentroids;
+	for (unsigned int j = 0; j < centroids.size(); j++) {
+		startCentroids.push_back(DataPoint(centroids[j]->getVector(), "start"));
+	}
+
+	// Starting from the converged clustering changes nothing
+	KMeansClustering warm(points, 5);
+	warm.setInitialCentroids(startCentroids, assignments);
+	CPPUNIT_ASSERT( warm.run() == 1 );
+	std::vector<int> warmAssignments;
+	warm.getAssignments(warmAssignments);
+	for (unsigned int i = 0; i < points.size(); i++) {
+		// The centroid points of the first run are assigned in the second one
+		if (assignments[i] >= 0) {
+			CPPUNIT_ASSERT( warmAssignments[i] == assignments[i] );
+		}
+	}
+}
+
+
+
+void ClusteringTest::testSpherical(void) {
+	std::vector<DataPoint> points;
+	createBlobs(points, 400, 4, 6, 4);
+	SphericalKMeans kMeans(points, 4);
+	kMeans.setInitialization(KMeansClustering::KMEANS_PARALLEL_INIT);
+	kMeans.run();
+
+	// The centroids are unit vectors and every point is in the cluster of its closest centroid
+	std::vector<DataPoint *> centroids = kMeans.getCentroids();
+	for (unsigned int j = 0; j < centroids.size(); j++) {
+		if (centroids[j]->getID() == "dummy") {
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( 1.0, centroids[j]->getNorm(), 0.000000001 );
+		}
+	}
+	std::vector<int> assignments;
+	kMeans.getAssignments(assignments);
+	for (unsigned int i = 0; i < points.size(); i++) {
+		if (assignments[i] >= 0 && centroids[assignments[i]] != &points[i]) {
+			double minDist = -1.0;
+			int nearest = points[i].findNearest(centroids, minDist, &Metrics::cosineDistance);
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( minDist, Metrics::cosineDistance(points[i], *centroids[assignments[i]]), 0.000000001 );
+			CPPUNIT_ASSERT( nearest >= 0 );
+		}
+	}
+}
+
+
+
+void ClusteringTest::testStreaming(void) {
+	std::vector<DataPoint> points;
+	createBlobs(points, 503, 4, 3, 5);
+	std::ofstream output("UnitTesting/test_files/stream_points.csv");
+	output.precision(10);
+	output << std::fixed;
+	for (unsigned int i = 0; i < points.size(); i++) {
+		output << points[i].getID();
+		for (unsigned int t = 0; t < points[i].getDimensions(); t++) {
+			output << "\t" << points[i].at(t);
+		}
+		output << std::endl;
+	}
+	output.close();
+
+	// Chunks that don't divide the points: every ID is in exactly one cluster
+	StreamingKMeans streamingKMeans("UnitTesting/test_files/stream_points.csv", 4, Metrics::EUCLIDEAN, 10);
+	CPPUNIT_ASSERT( streamingKMeans.run() > 0 );
+	CPPUNIT_ASSERT( streamingKMeans.getNumberOfPoints() == points.size() );
+	std::vector< std::vector<std::string> > clusters;
+	streamingKMeans.getPointsPerCluster(clusters);
+	CPPUNIT_ASSERT( clusters.size() == 4 );
+
+	std::set<std::string> found;
+	unsigned int total = 0;
+	for (unsigned int j = 0; j < clusters.size(); j++) {
+		total += clusters[j].size();
+		found.insert(clusters[j].begin(), clusters[j].end());
+	}
+	CPPUNIT_ASSERT( total == points.size() );
+	CPPUNIT_ASSERT( found.size() == points.size() );
+	for (unsigned int i = 0; i < points.size(); i++) {
+		CPPUNIT_ASSERT( found.count(points[i].getID()) == 1 );
+	}
+
+	// The same seed gives the same clusters
+	StreamingKMeans first("UnitTesting/test_files/stream_points.csv", 4, Metrics::EUCLIDEAN, 10);
+	StreamingKMeans second("UnitTesting/test_files/stream_points.csv", 4, Metrics::EUCLIDEAN, 10);
+	first.setSeed(7);
+	second.setSeed(7);
+	CPPUNIT_ASSERT( first.run() > 0 && second.run() > 0 );
+	std::vector< std::vector<std::string> > firstClusters, secondClusters;
+	first.getPointsPerCluster(firstClusters);
+	second.getPointsPerCluster(secondClusters);
+	CPPUNIT_ASSERT( firstClusters == secondClusters );
+
+	// A missing file is an error
+	StreamingKMeans missing("UnitTesting/test_files/missing.csv", 4, Metrics::EUCLIDEAN, 10);
+	CPPUNIT_ASSERT( missing.run() == -1 );
+	remove("UnitTesting/test_files/stream_points.csv");
+}
+
+
+
+void ClusteringTest::testLSHAssignment(void) {
+	std::vector<DataPoint> points;
+	createBlobs(points, 500, 5, 8, 6);
+
+	// With many h_i functions a point shares a bucket only with a centroid of almost the same
+	// direction (its own) and the other points fall back to every centroid, so the LSH
+	// assignment is the exact one from the same k-means++ centroids
+	std::vector<int> assignments[2];
+	std::vector<DataPoint> centroids[2];
+	for (unsigned int run = 0; run < 2; run++) {
+		KMeansClustering *kMeans = (run == 1) ? new LSHSphericalKMeans(points, 5, 24, 2) : new SphericalKMeans(points, 5);
+		kMeans->setInitialization(KMeansClustering::KMEANS_PP_INIT);
+		kMeans->setSeed(7);
+		kMeans->run();
+		kMeans->getAssignments(assignments[run]);
+		std::vector<DataPoint *> runCentroids = kMeans->getCentroids();
+		for (unsigned int j = 0; j < runCentroids.size(); j++) {
+			centroids[run].push_back(*runCentroids[j]);
+		}
+		delete kMeans;
+	}
+
+	CPPUNIT_ASSERT( assignments[1] == assignments[0] );
+	for (unsigned int j = 0; j < centroids[0].size(); j++) {
+		for (unsigned int t = 0; t < 8; t++) {
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( centroids[0][j].at(t), centroids[1][j].at(t), 0.000000001 );
+		}
+	}
+}
+
+
+
+void ClusteringTest::testBisecting(void) {
+	std::vector<DataPoint> points;
+	createBlobs(points, 600, 6, 5, 8);
+
+	// Exactly k non-empty clusters, also for k that isn't a power of 2 or the number of blobs
+	unsigned int sizes[3] = {6, 11, 32};
+	for (unsigned int s = 0; s < 3; s++) {
+		BisectingKMeans kMeans(points, sizes[s], Metrics::EUCLIDEAN);
+		kMeans.setSeed(9);
+		kMeans.run();
+		CPPUNIT_ASSERT( kMeans.getCentroids().size() == sizes[s] );
+		std::vector<unsigned int> counts;
+		kMeans.getNumberOfPointsPerCluster(counts);
+		CPPUNIT_ASSERT( counts.size() == sizes[s] );
+		unsigned int total = 0;
+		for (unsigned int j = 0; j < counts.size(); j++) {
+			CPPUNIT_ASSERT( counts[j] > 0 );
+			total += counts[j];
+		}
+		CPPUNIT_ASSERT( total == points.size() );
+	}
+
+	// Blobs in pairs of pairs of pairs (each level 10 times further apart), so that every
+	// split of the tree separates two groups of blobs: the descent of the tree finds the
+	// closest centroid (the one of the cluster of the point)
+	std::default_random_engine generator(10);
+	std::normal_distribution<double> noise(0.0, 1.0);
+	std::vector<DataPoint> nested;
+	for (unsigned int i = 0; i < 800; i++) {
+		unsigned int blob = i % 8;
+		std::vector<double> coordinates(3);
+		for (unsigned int t = 0; t < 3; t++) {
+			coordinates[t] = ((blob >> t) & 1) * 10.0 * pow(10.0, t) + noise(generator);
+		}
+		nested.push_back(DataPoint(coordinates, std::to_string(i)));
+	}
+
+	BisectingKMeans kMeans(nested, 8, Metrics::EUCLIDEAN);
+	kMeans.run();
+	std::vector<int> assignments;
+	kMeans.getAssignments(assignments);
+	std::vector<DataPoint *> centroids = kMeans.getCentroids();
+	CPPUNIT_ASSERT( centroids.size() == 8 );
+	for (unsigned int i = 0; i < nested.size(); i++) {
+		double minDist = -1.0;
+		int nearest = nested[i].findNearest(centroids, minDist, &Metrics::euclideanDistance);
+		CPPUNIT_ASSERT( kMeans.nearestCluster(nested[i]) == nearest );
+		CPPUNIT_ASSERT( assignments[i] == nearest );
+		// Every cluster is one blob
+		CPPUNIT_ASSERT( assignments[i] == assignments[i % 8] );
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef CLUSTERING_TEST_H
+#define CLUSTERING_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class ClusteringTest: public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE( ClusteringTest );
+	CPPUNIT_TEST( testAssignment );
+	CPPUNIT_TEST( testSampledSilhouette );
+	CPPUNIT_TEST( testWarmStart );
+	CPPUNIT_TEST( testSpherical );
+	CPPUNIT_TEST( testStreaming );
+	CPPUNIT_TEST( testLSHAssignment );
+	CPPUNIT_TEST( testBisecting );
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void testAssignment(void);
+	void testSampledSilhouette(void);
+	void testWarmStart(void);
+	void testSpherical(void);
+	void testStreaming(void);
+	void testLSHAssignment(void);
+	void testBisecting(void);
+};
+
+#endif // CLUSTERING_TEST_H
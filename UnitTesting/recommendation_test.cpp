@@ -0,0 +1,153 @@
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <set>
+#include <memory>
+#include <random>
+#include <fstream>
+#include <cstdio> // remove
+#include "recommendation_test.h"
+#include "../recommendation.h"
+#include "../clustering_recommender.h"
+#include "../neighbor_search.h"
+#include "../sentiment_aggregator.h"
+#include "../tweet.h"
+#include <cppunit/extensions/HelperMacros.h>
+
+static const char *PROCESSED_FILE = "UnitTesting/test_files/rec_processed.csv";
+
+// A scored tweet with one sentiment word and one coin
+static Tweet createTweet(unsigned int user, unsigned int id, const std::string& word, unsigned int coin,
+		const std::unordered_map<std::string, double>& sentimentMap, const std::vector< std::vector<std::string> >& coins) {
+	Tweet tweet;
+	tweet.readTweet(std::to_string(user) + "\t" + std::to_string(id) + "\t" + word + "\t" + coins[coin][0] + "\tthe");
+	tweet.calculateSentiments(sentimentMap, 15, coins);
+	return tweet;
+}
+
+// The users, averages and unrated coins of a model (compared after it's released)
+struct ModelCopy {
+	std::vector< std::vector<double> > users;
+	std::vector<double> averages;
+	std::unordered_map<unsigned int, std::set<unsigned int> > unknownCoins;
+
+	ModelCopy(const RecommendationModel& model) : averages(model.usersAverageSentiment), unknownCoins(model.unknownCoins) {
+		for (unsigned int i = 0; i < model.userSentiments.size(); i++) {
+			users.push_back(model.userSentiments[i].getVector());
+		}
+	}
+};
+
+// Check that only the given users (by ID) differ in the first users of the model
+static void assertOnlyChanged(const ModelCopy& before, const ModelCopy& after, const std::set<unsigned int>& changed) {
+	CPPUNIT_ASSERT( after.users.size() >= before.users.size() );
+	for (unsigned int i = 0; i < before.users.size(); i++) {
+		// The users are in the order of their IDs (1, 2, ...)
+		unsigned int userID = i + 1;
+		bool same = (before.users[i] == after.users[i] && before.averages[i] == after.averages[i]
+			&& before.unknownCoins.at(userID) == after.unknownCoins.at(userID));
+		CPPUNIT_ASSERT( same == (changed.count(userID) == 0) );
+	}
+}
+
+
+
+void RecommendationTest::testAddTweets(void) {
+	std::unordered_map<std::string, double> sentimentMap;
+	sentimentMap["good"] = 2.0;
+	sentimentMap["great"] = 3.0;
+	sentimentMap["bad"] = -2.0;
+	sentimentMap["awful"] = -3.0;
+	std::vector<std::string> words;
+	for (std::unordered_map<std::string, double>::const_iterator it = sentimentMap.begin(); it != sentimentMap.end(); it++) {
+		words.push_back(it->first);
+	}
+	std::vector< std::vector<std::string> > coins;
+	for (unsigned int j = 0; j < 8; j++) {
+		coins.push_back(std::vector<std::string>{"c" + std::to_string(j), "#c" + std::to_string(j)});
+	}
+
+	// 40 users with 3 tweets each and the processed vectors of the tweets
+	std::default_random_engine generator(11);
+	std::uniform_int_distribution<unsigned int> word(0, words.size() - 1);
+	std::uniform_int_distribution<unsigned int> coin(0, coins.size() - 1);
+	std::normal_distribution<double> coordinate(0.0, 1.0);
+	std::vector<Tweet> tweets;
+	std::ofstream processed(PROCESSED_FILE);
+	for (unsigned int i = 0; i < 120; i++) {
+		tweets.push_back(createTweet(i / 3 + 1, i + 1, words[word(generator)], coin(generator), sentimentMap, coins));
+		processed << i + 1;
+		for (unsigned int t = 0; t < 5; t++) {
+			processed << "\t" << coordinate(generator);
+		}
+		processed << std::endl;
+	}
+	processed.close();
+
+	RecommendationParameters parameters;
+	parameters.processedTweetsFile = PROCESSED_FILE;
+	parameters.tweetClusters = 4;
+	Recommendation rec(tweets, 5, ClusteringRecommender::DEFAULT_CLUSTERS, 3, NeighborSearch::EXACT_SEARCH, "",
+		SentimentAggregator::SUM_AGGREGATION, 0.0, parameters);
+	remove(PROCESSED_FILE);
+
+
+	// A tweet of a known user (about a coin he hasn't rated) and of a new user while a
+	// snapshot of the model is held: the snapshot doesn't change
+	std::shared_ptr<const RecommendationModel> snapshot = rec.getModel();
+	ModelCopy initial(*snapshot);
+	unsigned int firstCoin = *initial.unknownCoins.at(3).begin();
+	std::vector<Tweet> added;
+	added.push_back(createTweet(3, 1001, "great", firstCoin, sentimentMap, coins));
+	added.push_back(createTweet(41, 1002, "bad", 2, sentimentMap, coins));
+	CPPUNIT_ASSERT( rec.addTweets(added) == 2 );
+
+	std::shared_ptr<const RecommendationModel> updated = rec.getModel();
+	CPPUNIT_ASSERT( updated != snapshot );
+	assertOnlyChanged(initial, ModelCopy(*snapshot), std::set<unsigned int>());
+	ModelCopy first(*updated);
+	assertOnlyChanged(initial, first, std::set<unsigned int>{3});
+	CPPUNIT_ASSERT( first.users.size() == initial.users.size() + 1 );
+	CPPUNIT_ASSERT( updated->userToSentiment.at(41) == initial.users.size() );
+	CPPUNIT_ASSERT( first.unknownCoins.at(3).count(firstCoin) == 0 );
+	CPPUNIT_ASSERT( first.unknownCoins.at(41).size() == coins.size() - 1 );
+
+	// Both models are still read, so the next update copies the current one
+	added.clear();
+	added.push_back(createTweet(5, 1003, "awful", 0, sentimentMap, coins));
+	CPPUNIT_ASSERT( rec.addTweets(added) == 1 );
+	std::shared_ptr<const RecommendationModel> copied = rec.getModel();
+	CPPUNIT_ASSERT( copied != updated );
+	ModelCopy second(*copied);
+	assertOnlyChanged(first, second, std::set<unsigned int>{5});
+
+	// The recommenders of the copy use its own users and recommend only unrated coins
+	for (std::unordered_map<unsigned int, unsigned int>::const_iterator it = copied->userToSentiment.begin(); it != copied->userToSentiment.end(); it++) {
+		const std::set<unsigned int>& unknown = copied->unknownCoins.at(it->first);
+		std::vector<unsigned int> result1 = copied->rec1->recommendations(copied->userSentiments[it->second], unknown);
+		std::vector<unsigned int> result2 = copied->rec2->recommendations(copied->userSentiments[it->second], unknown);
+		for (unsigned int i = 0; i < result1.size(); i++) {
+			CPPUNIT_ASSERT( unknown.count(result1[i]) == 1 );
+		}
+		for (unsigned int i = 0; i < result2.size(); i++) {
+			CPPUNIT_ASSERT( unknown.count(result2[i]) == 1 );
+		}
+	}
+	copied.reset();
+
+	// Without readers the model replaced by the last update gets the updates
+	// it doesn't have (users 5 and 7) and replaces the current one
+	const RecommendationModel *firstModel = updated.get();
+	snapshot.reset();
+	updated.reset();
+	added.clear();
+	added.push_back(createTweet(7, 1004, "good", 1, sentimentMap, coins));
+	CPPUNIT_ASSERT( rec.addTweets(added) == 1 );
+	std::shared_ptr<const RecommendationModel> reused = rec.getModel();
+	CPPUNIT_ASSERT( reused.get() == firstModel );
+	ModelCopy third(*reused);
+	assertOnlyChanged(second, third, std::set<unsigned int>{7});
+	assertOnlyChanged(first, third, std::set<unsigned int>{5, 7});
+	CPPUNIT_ASSERT( third.users.size() == first.users.size() );
+	CPPUNIT_ASSERT( third.users.back() == first.users.back() );
+}
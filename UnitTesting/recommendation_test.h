@@ -0,0 +1,14 @@
+#ifndef RECOMMENDATION_TEST_H
+#define RECOMMENDATION_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class RecommendationTest: public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE( RecommendationTest );
+	CPPUNIT_TEST( testAddTweets );
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void testAddTweets(void);
+};
+
+#endif // RECOMMENDATION_TEST_H
@@ -0,0 +1,353 @@
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio> // remove
+#include <algorithm> // std::sort, std::unique
+#include <utility> // std::pair, std::make_pair
+#include "search_test.h"
+#include "../exact_search.h"
+#include "../hnsw.h"
+#include "../LSH/LSH.h"
+#include "../LSH/hash_table.h"
+#include "../LSH/cosine_hash_table.h"
+#include "../matrix.h"
+#include "../data_point.h"
+#include "../metrics.h"
+#include <cppunit/extensions/HelperMacros.h>
+
+// LSH that also returns the candidates of its hash tables without the signature filter
+class CandidateLSH: public LSH {
+public:
+	CandidateLSH(int k, int d, int L, int n, unsigned int bits, unsigned int rerank) : LSH(k, d, L, n, bits, rerank) {}
+
+	void findCandidates(const DataPoint& q, std::vector<DataPoint *>& candidates) const {
+		std::vector<int> g;
+		for (int i = 0; i < L; i++) {
+			tables[i]->computeG(q, g);
+			tables[i]->findCandidates(g, candidates);
+		}
+		std::sort(candidates.begin(), candidates.end());
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+	}
+};
+
+
+
+void SearchTest::testExactSearch(void) {
+	// Points on the unit circle at 0, 10, 20, ..., 90 degrees
+	std::vector<DataPoint> points;
+	for (unsigned int i = 0; i < 10; i++) {
+		std::vector<double> coordinates(2);
+		coordinates[0] = cos(i * 10 * M_PI / 180);
+		coordinates[1] = sin(i * 10 * M_PI / 180);
+		points.push_back(DataPoint(coordinates, std::to_string(i)));
+	}
+
+	ExactSearch search(2);
+	for (unsigned int i = 0; i < points.size(); i++) {
+		search.insert(points[i]);
+	}
+
+	// Query at 42 degrees (scaled, since only the direction matters)
+	std::vector<double> queryVec(2);
+	queryVec[0] = 5 * cos(42 * M_PI / 180);
+	queryVec[1] = 5 * sin(42 * M_PI / 180);
+	DataPoint query(queryVec, "query");
+
+	std::vector<DataPoint *> neighbors;
+	std::vector<double> distances;
+	search.findNearestNeighbors(query, 3, neighbors, distances);
+
+	CPPUNIT_ASSERT( neighbors.size() == 3 );
+	CPPUNIT_ASSERT( neighbors[0]->getID() == "4" );
+	CPPUNIT_ASSERT( neighbors[1]->getID() == "5" );
+	CPPUNIT_ASSERT( neighbors[2]->getID() == "3" );
+	for (unsigned int i = 0; i < neighbors.size(); i++) {
+		CPPUNIT_ASSERT_DOUBLES_EQUAL( distances[i], Metrics::cosineDistance(query, *neighbors[i]), 0.000000001 );
+	}
+
+	// Asking for more neighbors than the points returns every point
+	neighbors.clear();
+	distances.clear();
+	search.findNearestNeighbors(query, 20, neighbors, distances);
+	CPPUNIT_ASSERT( neighbors.size() == 10 );
+}
+
+
+
+void SearchTest::testExactSearchBatch(void) {
+	std::vector<DataPoint> points;
+	for (unsigned int i = 0; i < 200; i++) {
+		std::vector<double> coordinates(5);
+		for (unsigned int j = 0; j < coordinates.size(); j++) {
+			coordinates[j] = ((i * 7 + j * 13) % 17) - 8.0;
+		}
+		points.push_back(DataPoint(coordinates, std::to_string(i)));
+	}
+
+	ExactSearch search(5);
+	std::vector<const DataPoint *> queries;
+	for (unsigned int i = 0; i < points.size(); i++) {
+		search.insert(points[i]);
+		queries.push_back(&points[i]);
+	}
+
+	std::vector< std::vector<DataPoint *> > batchNeighbors;
+	std::vector< std::vector<double> > batchDistances;
+	search.findNearestNeighborsBatch(queries, 4, batchNeighbors, batchDistances);
+	CPPUNIT_ASSERT( batchNeighbors.size() == points.size() );
+
+	// The batch must match the queries answered one at a time
+	for (unsigned int i = 0; i < queries.size(); i++) {
+		std::vector<DataPoint *> neighbors;
+		std::vector<double> distances;
+		search.findNearestNeighbors(*queries[i], 4, neighbors, distances);
+		CPPUNIT_ASSERT( distances == batchDistances[i] );
+		// Every point is its own nearest neighbor
+		CPPUNIT_ASSERT( distances[0] == 0.0 );
+	}
+}
+
+
+
+void SearchTest::testHNSW(void) {
+	std::vector<DataPoint> points;
+	for (unsigned int i = 0; i < 1000; i++) {
+		std::vector<double> coordinates(8);
+		for (unsigned int j = 0; j < coordinates.size(); j++) {
+			coordinates[j] = ((i * 31 + j * 17 + i * j * 7) % 101) - 50.0;
+		}
+		points.push_back(DataPoint(coordinates, std::to_string(i)));
+	}
+
+	ExactSearch exact(8);
+	exact.insertAll(points);
+	HNSW graph(8, 8, 100, 50, 2);
+	graph.insertAll(points);
+
+	// Compare the neighbors found with the exact ones
+	unsigned int found = 0;
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < points.size(); i += 10) {
+		std::vector<DataPoint *> exactNeighbors;
+		std::vector<DataPoint *> graphNeighbors;
+		std::vector<double> distances;
+		exact.findNearestNeighbors(points[i], 5, exactNeighbors, distances);
+		graph.findNearestNeighbors(points[i], 5, graphNeighbors, distances);
+
+		CPPUNIT_ASSERT( graphNeighbors.size() == 5 );
+		for (unsigned int j = 0; j < exactNeighbors.size(); j++) {
+			total++;
+			for (unsigned int k = 0; k < graphNeighbors.size(); k++) {
+				if (graphNeighbors[k] == exactNeighbors[j]) {
+					found++;
+					break;
+				}
+			}
+		}
+	}
+	CPPUNIT_ASSERT( found >= 0.9 * total );
+
+	// A saved graph is loaded only for the same points
+	CPPUNIT_ASSERT( graph.save("UnitTesting/test_files/graph.hnsw") == true );
+	HNSW loaded(8);
+	CPPUNIT_ASSERT( loaded.load("UnitTesting/test_files/graph.hnsw", points) == true );
+
+	std::vector<DataPoint *> neighbors;
+	std::vector<double> distances;
+	std::vector<DataPoint *> loadedNeighbors;
+	std::vector<double> loadedDistances;
+	graph.findNearestNeighbors(points[0], 5, neighbors, distances);
+	loaded.findNearestNeighbors(points[0], 5, loadedNeighbors, loadedDistances);
+	CPPUNIT_ASSERT( neighbors == loadedNeighbors );
+
+	// Same IDs with other coordinates
+	std::vector<DataPoint> changed = points;
+	std::vector<double> coordinates(8, 1.0);
+	changed[500] = DataPoint(coordinates, points[500].getID());
+	HNSW stale(8);
+	CPPUNIT_ASSERT( stale.load("UnitTesting/test_files/graph.hnsw", changed) == false );
+
+	points.pop_back();
+	HNSW mismatching(8);
+	CPPUNIT_ASSERT( mismatching.load("UnitTesting/test_files/graph.hnsw", points) == false );
+	remove("UnitTesting/test_files/graph.hnsw");
+}
+
+
+
+void SearchTest::testUpdate(void) {
+	// Points on the unit circle at 0, 10, 20, ..., 350 degrees
+	std::vector<DataPoint> points;
+	for (unsigned int i = 0; i < 36; i++) {
+		std::vector<double> coordinates(2);
+		coordinates[0] = cos(i * 10 * M_PI / 180);
+		coordinates[1] = sin(i * 10 * M_PI / 180);
+		points.push_back(DataPoint(coordinates, std::to_string(i)));
+	}
+
+	ExactSearch exact(2);
+	exact.insertAll(points);
+	HNSW graph(2, 4, 50, 50, 1);
+	graph.insertAll(points);
+
+	// Move the point at 0 degrees to 45 degrees
+	std::vector<double> moved(2);
+	moved[0] = cos(45 * M_PI / 180);
+	moved[1] = sin(45 * M_PI / 180);
+	points[0] = DataPoint(moved, "0");
+	exact.update(points[0]);
+	graph.update(points[0]);
+
+	std::vector<double> queryVec(2);
+	queryVec[0] = cos(44 * M_PI / 180);
+	queryVec[1] = sin(44 * M_PI / 180);
+	DataPoint query(queryVec, "query");
+
+	std::vector<DataPoint *> neighbors;
+	std::vector<double> distances;
+	exact.findNearestNeighbors(query, 1, neighbors, distances);
+	CPPUNIT_ASSERT( neighbors.size() == 1 && neighbors[0] == &points[0] );
+	CPPUNIT_ASSERT( std::abs(distances[0] - (1 - cos(M_PI / 180))) < 1e-9 );
+
+	neighbors.clear();
+	distances.clear();
+	graph.findNearestNeighbors(query, 1, neighbors, distances);
+	CPPUNIT_ASSERT( neighbors.size() == 1 && neighbors[0] == &points[0] );
+}
+
+
+
+void SearchTest::testSignatureFilter(void) {
+	std::vector<DataPoint> points;
+	for (unsigned int i = 0; i < 500; i++) {
+		std::vector<double> coordinates(8);
+		for (unsigned int j = 0; j < coordinates.size(); j++) {
+			coordinates[j] = ((i * 31 + j * 17 + i * j * 7) % 101) - 50.0;
+		}
+		points.push_back(DataPoint(coordinates, std::to_string(i)));
+	}
+
+	// Every candidate is reranked, so the results are the closest candidates of the tables
+	CandidateLSH lsh(3, 8, 4, points.size(), 128, points.size());
+	lsh.insertAll(points);
+	std::vector<const DataPoint *> queries;
+	for (unsigned int i = 0; i < points.size(); i += 10) {
+		queries.push_back(&points[i]);
+	}
+	std::vector< std::vector<DataPoint *> > batchNeighbors;
+	std::vector< std::vector<double> > batchDistances;
+	lsh.findNearestNeighborsBatch(queries, 5, batchNeighbors, batchDistances);
+
+	for (unsigned int q = 0; q < queries.size(); q++) {
+		std::vector<DataPoint *> candidates;
+		lsh.findCandidates(*queries[q], candidates);
+		std::vector< std::pair<double, DataPoint *> > expected;
+		for (unsigned int j = 0; j < candidates.size(); j++) {
+			expected.push_back(std::make_pair(Metrics::cosineDistance(*queries[q], *candidates[j]), candidates[j]));
+		}
+		std::sort(expected.begin(), expected.end());
+
+		std::vector<DataPoint *> neighbors;
+		std::vector<double> distances;
+		lsh.findNearestNeighbors(*queries[q], 5, neighbors, distances);
+		CPPUNIT_ASSERT( neighbors.size() == std::min((size_t) 5, expected.size()) );
+		CPPUNIT_ASSERT( batchNeighbors[q] == neighbors );
+		for (unsigned int j = 0; j < neighbors.size(); j++) {
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( expected[j].first, distances[j], 0.000000001 );
+		}
+	}
+
+	// Only the candidates with the closest signatures are kept
+	CandidateLSH filtered(1, 8, 2, points.size(), 128, 10);
+	filtered.insertAll(points);
+	std::vector<DataPoint *> neighbors;
+	std::vector<double> distances;
+	filtered.findAllNeighbors(points[0], neighbors, distances);
+	CPPUNIT_ASSERT( neighbors.size() == 10 );
+}
+
+
+
+void SearchTest::testHadamard(void) {
+	// The columns of the (unnormalized) transform are orthogonal with squared norm n
+	const unsigned int n = 16;
+	std::vector< std::vector<double> > columns;
+	for (unsigned int i = 0; i < n; i++) {
+		std::vector<double> column(n, 0.0);
+		column[i] = 1.0;
+		fastWalshHadamard(&column[0], n);
+		columns.push_back(column);
+	}
+	for (unsigned int i = 0; i < n; i++) {
+		for (unsigned int j = 0; j < n; j++) {
+			double product = 0.0;
+			for (unsigned int t = 0; t < n; t++) {
+				product += columns[i][t] * columns[j][t];
+			}
+			CPPUNIT_ASSERT_DOUBLES_EQUAL( (i == j) ? (double) n : 0.0, product, 0.000000001 );
+		}
+	}
+
+	// Applying it twice gives n * x
+	std::vector<double> x(n);
+	for (unsigned int i = 0; i < n; i++) {
+		x[i] = (i * 7 % 5) - 2.5;
+	}
+	std::vector<double> y = x;
+	fastWalshHadamard(&y[0], n);
+	fastWalshHadamard(&y[0], n);
+	for (unsigned int i = 0; i < n; i++) {
+		CPPUNIT_ASSERT_DOUBLES_EQUAL( n * x[i], y[i], 0.000000001 );
+	}
+}
+
+
+
+void SearchTest::testStructuredHashing(void) {
+	// Two points at an angle get the same bit with probability 1 - angle / 180 degrees
+	const unsigned int d = 12;
+	double angles[3] = { 10, 90, 170 };
+	for (unsigned int a = 0; a < 3; a++) {
+		unsigned int collisions = 0;
+		unsigned int total = 0;
+		for (unsigned int pair = 0; pair < 20; pair++) {
+			// Unit vectors u and w orthogonal to each other
+			std::vector<double> u(d, 0.0);
+			std::vector<double> w(d, 0.0);
+			for (unsigned int j = 0; j < d; j++) {
+				u[j] = ((pair * 13 + j * 29 + pair * j * 5) % 23) - 11.0;
+				w[j] = ((pair * 17 + j * 11 + pair * j * 3) % 19) - 9.0;
+			}
+			normalizeRow(&u[0], d);
+			double dot = 0.0;
+			for (unsigned int j = 0; j < d; j++) {
+				dot += u[j] * w[j];
+			}
+			for (unsigned int j = 0; j < d; j++) {
+				w[j] -= dot * u[j];
+			}
+			normalizeRow(&w[0], d);
+
+			std::vector<double> v(d);
+			for (unsigned int j = 0; j < d; j++) {
+				v[j] = cos(angles[a] * M_PI / 180) * u[j] + sin(angles[a] * M_PI / 180) * w[j];
+			}
+			DataPoint p(u, "p");
+			DataPoint q(v, "q");
+
+			for (unsigned int t = 0; t < 50; t++) {
+				CosineHashTable table(1, d, true);
+				std::vector<int> g1;
+				std::vector<int> g2;
+				table.computeG(p, g1);
+				table.computeG(q, g2);
+				if (g1 == g2) {
+					collisions++;
+				}
+				total++;
+			}
+		}
+		CPPUNIT_ASSERT_DOUBLES_EQUAL( 1 - angles[a] / 180, (double) collisions / total, 0.1 );
+	}
+}
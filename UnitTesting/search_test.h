@@ -0,0 +1,26 @@
+#ifndef SEARCH_TEST_H
+#define SEARCH_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class SearchTest: public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE( SearchTest );
+	CPPUNIT_TEST( testExactSearch );
+	CPPUNIT_TEST( testExactSearchBatch );
+	CPPUNIT_TEST( testHNSW );
+	CPPUNIT_TEST( testUpdate );
+	CPPUNIT_TEST( testSignatureFilter );
+	CPPUNIT_TEST( testHadamard );
+	CPPUNIT_TEST( testStructuredHashing );
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void testExactSearch(void);
+	void testExactSearchBatch(void);
+	void testHNSW(void);
+	void testUpdate(void);
+	void testSignatureFilter(void);
+	void testHadamard(void);
+	void testStructuredHashing(void);
+};
+
+#endif // SEARCH_TEST_H
@@ -0,0 +1,172 @@
+#include <vector>
+#include <set>
+#include "sentiment_aggregator_test.h"
+#include "../sentiment_aggregator.h"
+#include "../tweet.h"
+#include <cppunit/extensions/HelperMacros.h>
+
+static const double NOT_SET = Tweet::SENTIMENT_NOT_SET;
+
+// Sentiments of a tweet about two coins
+static std::vector<double> sentiment(double first, double second) {
+	std::vector<double> result;
+	result.push_back(first);
+	result.push_back(second);
+	return result;
+}
+
+
+
+void SentimentAggregatorTest::testSum(void) {
+	SentimentAggregator aggregator;
+	std::set<unsigned int> changed;
+	CPPUNIT_ASSERT( aggregator.add(1, sentiment(1.0, NOT_SET), 0.0, changed) == true );
+	CPPUNIT_ASSERT( aggregator.add(1, sentiment(2.0, 0.5), 1000.0, changed) == true );
+	CPPUNIT_ASSERT( changed.size() == 1 && changed.count(1) == 1 );
+
+	// The times and the rebase don't change the sums
+	aggregator.rebase(5000.0);
+	std::vector<double> total;
+	CPPUNIT_ASSERT( aggregator.total(1, total) == true );
+	CPPUNIT_ASSERT( total == sentiment(3.0, 0.5) );
+
+	// Unknown key
+	CPPUNIT_ASSERT( aggregator.contains(2) == false );
+	CPPUNIT_ASSERT( aggregator.total(2, total) == false );
+}
+
+
+
+void SentimentAggregatorTest::testDecayed(void) {
+	// Half-life of 10: a tweet weighs twice as much as a tweet 10 earlier
+	SentimentAggregator aggregator(SentimentAggregator::DECAYED_AGGREGATION, 10.0);
+	std::set<unsigned int> changed;
+	aggregator.add(1, sentiment(1.0, NOT_SET), 0.0, changed);
+	aggregator.add(1, sentiment(1.0, NOT_SET), 10.0, changed);
+	aggregator.add(2, sentiment(NOT_SET, 4.0), 20.0, changed);
+	CPPUNIT_ASSERT( aggregator.getNewest() == 20.0 );
+
+	// The totals are at the time of the first tweet
+	std::vector<double> total;
+	CPPUNIT_ASSERT( aggregator.total(1, total) == true );
+	CPPUNIT_ASSERT_DOUBLES_EQUAL( 3.0, total[0], 0.000000001 );
+	CPPUNIT_ASSERT( total[1] == NOT_SET );
+
+	// At the time of the newest tweet: 1/4 + 1/2 and 4
+	aggregator.rebase(20.0);
+	aggregator.total(1, total);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL( 0.75, total[0], 0.000000001 );
+	aggregator.total(2, total);
+	CPPUNIT_ASSERT( total[0] == NOT_SET );
+	CPPUNIT_ASSERT_DOUBLES_EQUAL( 4.0, total[1], 0.000000001 );
+}
+
+
+
+void SentimentAggregatorTest::testRebase(void) {
+	SentimentAggregator aggregator(SentimentAggregator::DECAYED_AGGREGATION, 1.0);
+	std::set<unsigned int> changed;
+	CPPUNIT_ASSERT( aggregator.add(1, sentiment(1.0, NOT_SET), 0.0, changed) == true );
+	CPPUNIT_ASSERT( aggregator.add(1, sentiment(1.0, NOT_SET), 64.0, changed) == true );
+
+	// More than 64 half-lives after the reference time: every total is scaled to the newest time
+	CPPUNIT_ASSERT( aggregator.add(2, sentiment(1.0, NOT_SET), 65.0, changed) == false );
+	std::vector<double> total;
+	aggregator.total(1, total);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL( 0.5, total[0], 0.000000001 );
+	aggregator.total(2, total);
+	CPPUNIT_ASSERT( total[0] == 1.0 );
+
+	aggregator.rebase(66.0);
+	aggregator.total(2, total);
+	CPPUNIT_ASSERT( total[0] == 0.5 );
+}
+
+
+
+void SentimentAggregatorTest::testWindow(void) {
+	SentimentAggregator aggregator(SentimentAggregator::WINDOW_AGGREGATION, 10.0);
+	std::set<unsigned int> changed;
+	aggregator.add(1, sentiment(1.0, NOT_SET), 0.0, changed);
+	aggregator.add(2, sentiment(2.0, NOT_SET), 5.0, changed);
+
+	// The first tweet leaves the window
+	changed.clear();
+	aggregator.add(1, sentiment(NOT_SET, 3.0), 12.0, changed);
+	CPPUNIT_ASSERT( changed.size() == 1 && changed.count(1) == 1 );
+	std::vector<double> total;
+	aggregator.total(1, total);
+	CPPUNIT_ASSERT( total == sentiment(NOT_SET, 3.0) );
+	aggregator.total(2, total);
+	CPPUNIT_ASSERT( total == sentiment(2.0, NOT_SET) );
+
+	// A tweet exactly one period old is out of the window
+	changed.clear();
+	aggregator.advance(15.0, changed);
+	CPPUNIT_ASSERT( changed.size() == 1 && changed.count(2) == 1 );
+	CPPUNIT_ASSERT( aggregator.contains(2) == true );
+	CPPUNIT_ASSERT( aggregator.total(2, total) == true );
+	CPPUNIT_ASSERT( total == sentiment(NOT_SET, NOT_SET) );
+
+	// Time never moves back
+	changed.clear();
+	aggregator.advance(1.0, changed);
+	CPPUNIT_ASSERT( changed.size() == 0 );
+	CPPUNIT_ASSERT( aggregator.getNewest() == 15.0 );
+}
+
+
+
+void SentimentAggregatorTest::testLateTweets(void) {
+	SentimentAggregator aggregator(SentimentAggregator::WINDOW_AGGREGATION, 10.0);
+	std::set<unsigned int> changed;
+	aggregator.add(1, sentiment(1.0, NOT_SET), 20.0, changed);
+	// Older than the last tweet of the window (kept in the heap)
+	aggregator.add(2, sentiment(2.0, NOT_SET), 15.0, changed);
+	// Already out of the window: the key is known without tweets
+	changed.clear();
+	CPPUNIT_ASSERT( aggregator.add(3, sentiment(4.0, NOT_SET), 8.0, changed) == true );
+	CPPUNIT_ASSERT( changed.size() == 0 );
+	CPPUNIT_ASSERT( aggregator.contains(3) == true );
+	std::vector<double> total;
+	CPPUNIT_ASSERT( aggregator.total(3, total) == true );
+	CPPUNIT_ASSERT( total.size() == 0 );
+
+	// The late tweet leaves the window before the first one of the window
+	aggregator.advance(26.0, changed);
+	CPPUNIT_ASSERT( changed.size() == 1 && changed.count(2) == 1 );
+	aggregator.total(2, total);
+	CPPUNIT_ASSERT( total == sentiment(NOT_SET, NOT_SET) );
+	aggregator.total(1, total);
+	CPPUNIT_ASSERT( total == sentiment(1.0, NOT_SET) );
+
+	changed.clear();
+	aggregator.advance(30.0, changed);
+	CPPUNIT_ASSERT( changed.size() == 1 && changed.count(1) == 1 );
+	aggregator.total(1, total);
+	CPPUNIT_ASSERT( total == sentiment(NOT_SET, NOT_SET) );
+}
+
+
+
+void SentimentAggregatorTest::testExactZero(void) {
+	SentimentAggregator aggregator(SentimentAggregator::WINDOW_AGGREGATION, 10.0);
+	std::set<unsigned int> changed;
+	aggregator.add(1, sentiment(0.1, NOT_SET), 0.0, changed);
+	aggregator.add(1, sentiment(0.2, NOT_SET), 1.0, changed);
+	aggregator.add(1, sentiment(0.7, NOT_SET), 2.0, changed);
+
+	std::vector<double> total;
+	aggregator.advance(11.0, changed);
+	aggregator.total(1, total);
+	CPPUNIT_ASSERT_DOUBLES_EQUAL( 0.7, total[0], 0.000000001 );
+
+	// Every tweet of the coin left: its total is 0 exactly, so a new tweet
+	// isn't added to a rounding error
+	aggregator.advance(12.0, changed);
+	aggregator.total(1, total);
+	CPPUNIT_ASSERT( total[0] == NOT_SET );
+	aggregator.add(1, sentiment(0.3, NOT_SET), 13.0, changed);
+	aggregator.total(1, total);
+	CPPUNIT_ASSERT( total[0] == 0.3 );
+}
@@ -0,0 +1,24 @@
+#ifndef SENTIMENT_AGGREGATOR_TEST_H
+#define SENTIMENT_AGGREGATOR_TEST_H
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class SentimentAggregatorTest: public CppUnit::TestFixture {
+	CPPUNIT_TEST_SUITE( SentimentAggregatorTest );
+	CPPUNIT_TEST( testSum );
+	CPPUNIT_TEST( testDecayed );
+	CPPUNIT_TEST( testRebase );
+	CPPUNIT_TEST( testWindow );
+	CPPUNIT_TEST( testLateTweets );
+	CPPUNIT_TEST( testExactZero );
+	CPPUNIT_TEST_SUITE_END();
+public:
+	void testSum(void);
+	void testDecayed(void);
+	void testRebase(void);
+	void testWindow(void);
+	void testLateTweets(void);
+	void testExactZero(void);
+};
+
+#endif // SENTIMENT_AGGREGATOR_TEST_H
@@ -7,6 +7,10 @@
 #include "tweet_test.h"
 #include "metrics_test.h"
 #include "file_test.h"
+#include "search_test.h"
+#include "clustering_test.h"
+#include "recommendation_test.h"
+#include "sentiment_aggregator_test.h"
 
 int runTests(void) {
 	CPPUNIT_NS::TestResult testResult;
@@ -20,6 +24,10 @@ int runTests(void) {
 	testRunner.addTest( TweetTest::suite() );
 	testRunner.addTest( MetricsTest::suite() );
 	testRunner.addTest( FileTest::suite() );
+	testRunner.addTest( SearchTest::suite() );
+	testRunner.addTest( ClusteringTest::suite() );
+	testRunner.addTest( RecommendationTest::suite() );
+	testRunner.addTest( SentimentAggregatorTest::suite() );
 
 	testRunner.run(testResult);
 
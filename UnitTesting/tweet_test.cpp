@@ -100,3 +100,27 @@ void TweetTest::testTweet(void) {
 	CPPUNIT_ASSERT( sentiments[0] == Tweet::SENTIMENT_NOT_SET );
 	CPPUNIT_ASSERT( std::abs(sentiments[1] - 0.61237) < 0.0001 );
 }
+
+
+
+void TweetTest::testTimedTweet(void) {
+	// The third column is the time
+	Tweet timed;
+	CPPUNIT_ASSERT( timed.readTweet("5\t7\t1500.5\tgood\tbtc", true) == true );
+	CPPUNIT_ASSERT( timed.getUser() == 5 );
+	CPPUNIT_ASSERT( timed.getID() == 7 );
+	CPPUNIT_ASSERT( timed.getTime() == 1500.5 );
+	CPPUNIT_ASSERT( timed.getTokens().size() == 2 );
+
+	// A missing or invalid time
+	Tweet invalid;
+	CPPUNIT_ASSERT( invalid.readTweet("5\t7\tgood\tbtc", true) == false );
+	Tweet missing;
+	CPPUNIT_ASSERT( missing.readTweet("5\t7", true) == false );
+
+	// Without times the column is a token
+	Tweet untimed;
+	CPPUNIT_ASSERT( untimed.readTweet("5\t7\t1500.5\tgood\tbtc") == true );
+	CPPUNIT_ASSERT( untimed.getTime() == 0.0 );
+	CPPUNIT_ASSERT( untimed.getTokens().size() == 3 );
+}
@@ -7,10 +7,12 @@ class TweetTest: public CppUnit::TestFixture {
 	CPPUNIT_TEST_SUITE( TweetTest );
 	CPPUNIT_TEST( testInvalidFile );
 	CPPUNIT_TEST( testTweet );
+	CPPUNIT_TEST( testTimedTweet );
 	CPPUNIT_TEST_SUITE_END();
 public:
 	void testInvalidFile(void);
 	void testTweet(void);
+	void testTimedTweet(void);
 };
 
 #endif // TWEET_TEST_H
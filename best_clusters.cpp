@@ -1,6 +1,8 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <cstring> // strcmp
+#include <cstdlib> // atoi
 #include "tweet.h"
 #include "recommendation.h"
 #include "clustering_recommender.h"
@@ -13,6 +15,15 @@
 using namespace std;
 
 int main(int argc, char *argv[]) {
+	// Evaluate with the exact silhouette unless a sample size is given
+	unsigned int silhouetteSample = 0;
+	if (argc == 3 && strcmp(argv[1], "-sample") == 0) {
+		silhouetteSample = atoi(argv[2]);
+	} else if (argc != 1) {
+		cout << "Usage: " << argv[0] << " [-sample <silhouette sample size>]" << endl;
+		return -1;
+	}
+
 	// Vector tweets
 	vector<Tweet> tweets;
 
@@ -65,7 +76,7 @@ int main(int argc, char *argv[]) {
 	clusterOptions.push_back(100);
 	clusterOptions.push_back(250);
 
-	vector<int> results = rec->findBestClusters(clusterOptions);
+	vector<int> results = rec->findBestClusters(clusterOptions, silhouetteSample);
 	cout << "Best number of clusters for real users: " << results[0] << endl;
 	cout << "Best number of clusters for virtual users: " << results[1] << endl;
 
@@ -1,15 +1,26 @@
 #include <iostream>
 #include <vector>
-#include <algorithm> // random_shuffle
+#include <algorithm> // std::shuffle
 #include <random>
 #include <chrono>
+#include <mutex>
+#include <unordered_set>
+#include <functional>
 #include "clustering.h"
 #include "data_point.h"
 #include "metrics.h"
+#include "thread_pool.h"
+#include "matrix.h"
+
+
+KMeansClustering::KMeansClustering(std::vector<DataPoint>& inputPoints, int numClusters)
+		: KMeansClustering(inputPoints, numClusters, Metrics::EUCLIDEAN) {}
+
 
 
 KMeansClustering::KMeansClustering(std::vector<DataPoint>& inputPoints, int numClusters, int metric)
-		: numberOfClusters(numClusters), clusters(numClusters) {
+		: initMethod(RANDOM_INIT), threads(0), pool(NULL), numberOfClusters(numClusters),
+		  miniBatchSize(0), miniBatchIterations(0), miniBatchTolerance(0.0), learningRate(COUNT_LEARNING_RATE), initialRate(1.0), rateDecay(0.0) {
 	// Invalid arguments
 	if (numClusters <= 1 || (unsigned int) numClusters >= inputPoints.size()) {
 		std::cerr << "Invalid number of clusters: " << numClusters << ". Number of points: " << inputPoints.size() << std::endl;
@@ -18,10 +29,16 @@ KMeansClustering::KMeansClustering(std::vector<DataPoint>& inputPoints, int numC
 
 	if (metric == Metrics::EUCLIDEAN) {
 		distFun = &Metrics::euclideanDistance;
-	} else {
-		distFun = &Metrics::cosineSimilarity;
+		spherical = false;
+	} else { // Spherical K-means
+		distFun = &Metrics::cosineDistance;
+		spherical = true;
 	}
 
+	// Initialize the seed for the random number generator
+	unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count();
+	generator.seed(seed);
+
 	for (unsigned int i = 0; i < inputPoints.size(); i++) {
 		if (inputPoints[i].getID() == "dummy") {
 			std::cerr << "Point ID: dummy is not allowed" << std::endl;
@@ -33,20 +50,249 @@ KMeansClustering::KMeansClustering(std::vector<DataPoint>& inputPoints, int numC
 
 
 
-/* Pick the centroids at random */
+/* Copy of the clusters of another clustering for a copy of its points. The centroids that
+ * are points of the dataset are the same elements of the copy. Nothing of a run is copied */
+KMeansClustering::KMeansClustering(const KMeansClustering& other, std::vector<DataPoint>& inputPoints)
+		: distFun(other.distFun), spherical(other.spherical), initMethod(other.initMethod), threads(other.threads), generator(other.generator), pool(NULL),
+		  numberOfClusters(other.numberOfClusters), clusterOfPoint(other.clusterOfPoint), centroidPoint(other.centroidPoint), clusterStart(other.clusterStart),
+		  miniBatchSize(other.miniBatchSize), miniBatchIterations(other.miniBatchIterations), miniBatchTolerance(other.miniBatchTolerance),
+		  learningRate(other.learningRate), initialRate(other.initialRate), rateDecay(other.rateDecay) {
+	for (unsigned int i = 0; i < other.points.size(); i++) {
+		points.push_back(&inputPoints[i]);
+	}
+	for (unsigned int j = 0; j < other.centroids.size(); j++) {
+		int index = other.pointIndex(other.centroids[j]);
+		centroids.push_back((index >= 0) ? points[index] : new DataPoint(*other.centroids[j]));
+	}
+	for (unsigned int i = 0; i < other.members.size(); i++) {
+		members.push_back(points[other.pointIndex(other.members[i])]);
+	}
+}
+
+
+
+/* Pick the initial centroids using the selected method */
 void KMeansClustering::initialize() {
+	if (initMethod == KMEANS_PP_INIT) {
+		initializePlusPlus();
+	} else if (initMethod == KMEANS_PARALLEL_INIT) {
+		initializeParallel();
+	} else {
+		initializeRandom();
+	}
+}
+
+
+
+/* Pick the centroids at random */
+void KMeansClustering::initializeRandom() {
 	// Shuffle the points and choose the k first points as the centroids
 	std::vector<int> indices;
 	for (unsigned int i = 0; i < points.size(); i++) {
 		indices.push_back(i);
 	}
 
-	srand(time(NULL));
-	std::random_shuffle(indices.begin(), indices.end());
+	std::shuffle(indices.begin(), indices.end(), generator);
 	for (int i = 0; i < numberOfClusters; i++) {
 		centroids.push_back(points[indices[i]]);
-		clusterOfPoint[points[indices[i]]->getID()] = i;
+		clusterOfPoint[indices[i]] = i;
+		centroidPoint[indices[i]] = true;
+	}
+}
+
+
+
+/* k-means++: pick each centroid with probability proportional to the
+ * squared distance of the point from its closest centroid already picked */
+void KMeansClustering::initializePlusPlus() {
+	std::vector<bool> picked(points.size(), false);
+	// Squared distance of every point from its closest centroid
+	std::vector<double> minDistances(points.size(), -1.0);
+
+	std::uniform_int_distribution<unsigned int> uniform(0, points.size() - 1);
+	unsigned int index = uniform(generator);
+	for (int i = 0; i < numberOfClusters; i++) {
+		if (i > 0) {
+			double total = 0.0;
+			for (unsigned int j = 0; j < minDistances.size(); j++) {
+				total += minDistances[j];
+			}
+			index = sampleIndex(minDistances, total);
+
+			// Every remaining point is a duplicate of a centroid: take any of them
+			while (picked[index]) {
+				index = uniform(generator);
+			}
+		}
+
+		picked[index] = true;
+		centroids.push_back(points[index]);
+		clusterOfPoint[index] = i;
+		centroidPoint[index] = true;
+		updateMinDistances(*points[index], minDistances);
+	}
+}
+
+
+
+/* k-means||: sample many candidates in a few rounds (each point independently
+ * and in parallel) and then reduce them to k centroids with weighted k-means++ */
+void KMeansClustering::initializeParallel() {
+	std::vector<double> minDistances(points.size(), -1.0);
+	std::vector<unsigned int> candidates;
+	std::vector<bool> picked(points.size(), false);
+
+	std::uniform_int_distribution<unsigned int> uniform(0, points.size() - 1);
+	unsigned int first = uniform(generator);
+	candidates.push_back(first);
+	picked[first] = true;
+	updateMinDistances(*points[first], minDistances);
+
+	double oversampling = PARALLEL_INIT_OVERSAMPLING * numberOfClusters;
+	for (unsigned int round = 0; round < PARALLEL_INIT_ROUNDS; round++) {
+		double total = 0.0;
+		for (unsigned int i = 0; i < minDistances.size(); i++) {
+			total += minDistances[i];
+		}
+		if (total == 0) { // Every point is a candidate or a duplicate of one
+			break;
+		}
+
+		// Sample every point with probability l * d^2 / total
+		unsigned int roundSeed = generator();
+		std::mutex sampledMutex;
+		std::vector< std::pair<unsigned int, unsigned int> > sampledRanges;
+		std::vector<unsigned int> sampled;
+		pool->parallelFor(points.size(), [&](unsigned int begin, unsigned int end) {
+			std::default_random_engine chunkGenerator(roundSeed + begin);
+			std::uniform_real_distribution<double> probability(0.0, 1.0);
+			std::vector<unsigned int> chunkSampled;
+			for (unsigned int i = begin; i < end; i++) {
+				if (!picked[i] && probability(chunkGenerator) < oversampling * minDistances[i] / total) {
+					chunkSampled.push_back(i);
+				}
+			}
+
+			std::unique_lock<std::mutex> lock(sampledMutex);
+			sampled.insert(sampled.end(), chunkSampled.begin(), chunkSampled.end());
+		});
+		// Same candidates order regardless of the order the chunks finished
+		std::sort(sampled.begin(), sampled.end());
+
+		// Update the distances with the new candidates
+		pool->parallelFor(points.size(), [&](unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; i++) {
+				for (unsigned int j = 0; j < sampled.size(); j++) {
+					double dist = distFun(*points[i], *points[sampled[j]]);
+					if (dist * dist < minDistances[i]) {
+						minDistances[i] = dist * dist;
+					}
+				}
+			}
+		});
+
+		for (unsigned int j = 0; j < sampled.size(); j++) {
+			picked[sampled[j]] = true;
+			candidates.push_back(sampled[j]);
+		}
+	}
+
+	// Weight every candidate by the number of points closest to it
+	std::vector<double> weights(candidates.size(), 0.0);
+	std::mutex weightsMutex;
+	pool->parallelFor(points.size(), [&](unsigned int begin, unsigned int end) {
+		std::vector<double> chunkWeights(candidates.size(), 0.0);
+		for (unsigned int i = begin; i < end; i++) {
+			unsigned int closest = 0;
+			double minDist = -1.0;
+			for (unsigned int j = 0; j < candidates.size(); j++) {
+				double dist = distFun(*points[i], *points[candidates[j]]);
+				if (dist < minDist || minDist < 0) {
+					minDist = dist;
+					closest = j;
+				}
+			}
+			chunkWeights[closest]++;
+		}
+
+		std::unique_lock<std::mutex> lock(weightsMutex);
+		for (unsigned int j = 0; j < candidates.size(); j++) {
+			weights[j] += chunkWeights[j];
+		}
+	});
+
+	// Weighted k-means++ on the candidates
+	std::vector<bool> chosen(candidates.size(), false);
+	std::vector<double> candidateDistances(candidates.size(), -1.0);
+	std::vector<double> sampleWeights(weights);
+	unsigned int centroidsFromCandidates = (candidates.size() < (unsigned int) numberOfClusters) ? candidates.size() : numberOfClusters;
+	for (unsigned int i = 0; i < centroidsFromCandidates; i++) {
+		double total = 0.0;
+		for (unsigned int j = 0; j < sampleWeights.size(); j++) {
+			total += sampleWeights[j];
+		}
+		unsigned int index = sampleIndex(sampleWeights, total);
+		while (chosen[index]) { // Only duplicates remain
+			index = (index + 1) % candidates.size();
+		}
+		chosen[index] = true;
+		centroids.push_back(points[candidates[index]]);
+		clusterOfPoint[candidates[index]] = i;
+		centroidPoint[candidates[index]] = true;
+
+		for (unsigned int j = 0; j < candidates.size(); j++) {
+			double dist = distFun(*points[candidates[j]], *points[candidates[index]]);
+			if (dist * dist < candidateDistances[j] || candidateDistances[j] < 0) {
+				candidateDistances[j] = dist * dist;
+			}
+			sampleWeights[j] = weights[j] * candidateDistances[j];
+		}
+	}
+
+	// Too few candidates: pick the rest of the centroids at random
+	for (int i = centroids.size(); i < numberOfClusters; i++) {
+		unsigned int index = uniform(generator);
+		while (picked[index]) {
+			index = uniform(generator);
+		}
+		picked[index] = true;
+		centroids.push_back(points[index]);
+		clusterOfPoint[index] = i;
+		centroidPoint[index] = true;
+	}
+}
+
+
+
+/* Pick an index with probability proportional to its weight */
+int KMeansClustering::sampleIndex(const std::vector<double>& weights, double total) {
+	std::uniform_real_distribution<double> distrib(0.0, total);
+	double r = distrib(generator);
+	double sum = 0.0;
+	for (unsigned int i = 0; i < weights.size(); i++) {
+		sum += weights[i];
+		if (r < sum) {
+			return i;
+		}
 	}
+
+	// Rounding errors or zero total weight
+	std::uniform_int_distribution<unsigned int> uniform(0, weights.size() - 1);
+	return uniform(generator);
+}
+
+
+
+/* Lower the squared distance of every point from its closest centroid using the new centroid */
+void KMeansClustering::updateMinDistances(const DataPoint& centroid, std::vector<double>& minDistances) const {
+	pool->parallelFor(points.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			double dist = distFun(*points[i], centroid);
+			if (dist * dist < minDistances[i] || minDistances[i] < 0) {
+				minDistances[i] = dist * dist;
+			}
+		}
+	});
 }
 
 
@@ -54,67 +300,395 @@ void KMeansClustering::initialize() {
 /* Assign each point to the closest centroid */
 void KMeansClustering::assign() {
 	// For every point, find closest centroid
-	for (unsigned int i = 0; i < points.size(); i++) {
-		if (clusterOfPoint[points[i]->getID()] < 0) { // Unassigned point
-			// Find nearest centroid to point
-			double minDist = -1.0;
-			int minIndex = points[i]->findNearest(centroids, minDist, distFun);
-			clusterOfPoint[points[i]->getID()] = minIndex;
-			clusters[minIndex].push_back(points[i]);
+	pool->parallelFor(points.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			// Centroids that are dataset points are not assigned to any cluster
+			if (!centroidPoint[i]) {
+				double minDist = -1.0;
+				clusterOfPoint[i] = points[i]->findNearest(centroids, minDist, distFun);
+			}
+		}
+	});
+}
+
+
+
+/* Copy the centroids to unit vectors */
+void SphericalKMeans::normalizeCentroids() {
+	unsigned int k = centroids.size();
+	unsigned int dimensions = points[0]->getDimensions();
+
+	unitCentroids.resize(k * dimensions);
+	for (unsigned int j = 0; j < k; j++) {
+		for (unsigned int t = 0; t < dimensions; t++) {
+			unitCentroids[j * dimensions + t] = centroids[j]->at(t);
 		}
+		normalizeRow(&unitCentroids[j * dimensions], dimensions);
 	}
 }
 
 
 
-/* Set the new centroid of each cluster as the mean of its points */
-unsigned int KMeansClustering::update() {
-	// vector of zeros used as initializer
-	std::vector<double> zero(points[0]->getDimensions());
-	std::fill(zero.begin(), zero.end(), 0.0);
+/* Assign every point to the centroid with the maximum dot product */
+void SphericalKMeans::assign() {
+	unsigned int k = centroids.size();
+	unsigned int dimensions = points[0]->getDimensions();
+	normalizeCentroids();
+
+	// The dot products of a block of points with every centroid
+	unsigned int blocks = (points.size() + SPHERICAL_BLOCK_SIZE - 1) / SPHERICAL_BLOCK_SIZE;
+	pool->parallelFor(blocks, [&](unsigned int begin, unsigned int end) {
+		std::vector<double> products(SPHERICAL_BLOCK_SIZE * k);
+		for (unsigned int block = begin; block < end; block++) {
+			unsigned int first = block * SPHERICAL_BLOCK_SIZE;
+			unsigned int rows = (points.size() - first < SPHERICAL_BLOCK_SIZE) ? points.size() - first : SPHERICAL_BLOCK_SIZE;
+			multiplyTransposed(&unitPoints[first * dimensions], rows, &unitCentroids[0], k, dimensions, &products[0]);
+
+			for (unsigned int r = 0; r < rows; r++) {
+				if (centroidPoint[first + r]) {
+					continue;
+				}
+
+				const double *row = &products[r * k];
+				int maxIndex = 0;
+				for (unsigned int j = 1; j < k; j++) {
+					if (row[j] > row[maxIndex]) {
+						maxIndex = j;
+					}
+				}
+				clusterOfPoint[first + r] = maxIndex;
+			}
+		}
+	});
+}
+
+
+
+/* Spherical assignment using an LSH index of the centroids (rebuilt because they moved):
+ * every point is compared only with the centroids in its buckets, or with every
+ * centroid if its buckets are empty */
+void LSHSphericalKMeans::assign() {
+	unsigned int k = centroids.size();
+	unsigned int dimensions = points[0]->getDimensions();
+	normalizeCentroids();
 
-	// Initialize the vector for every cluster to [0, 0, ..., 0]
-	std::vector<DataPoint *> newCentroids(numberOfClusters);
-	for (unsigned int i = 0; i < newCentroids.size(); i++) {
-		newCentroids[i] = new DataPoint(zero, "dummy");
+	// The centroids are indexed with their index as the ID (the LSH merges neighbors by ID)
+	delete centroidIndex;
+	centroidCopies.clear();
+	for (unsigned int j = 0; j < k; j++) {
+		std::vector<double> coordinates(unitCentroids.begin() + j * dimensions, unitCentroids.begin() + (j + 1) * dimensions);
+		centroidCopies.push_back(DataPoint(coordinates, std::to_string(j)));
 	}
+	centroidIndex = new LSH(lshHashFunctions, dimensions, lshTables, k);
+	for (unsigned int j = 0; j < k; j++) {
+		centroidIndex->insert(centroidCopies[j]);
+	}
+
+	unsigned int blocks = (points.size() + SPHERICAL_BLOCK_SIZE - 1) / SPHERICAL_BLOCK_SIZE;
+	pool->parallelFor(blocks, [&](unsigned int begin, unsigned int end) {
+		std::vector<const DataPoint *> queries;
+		std::vector< std::vector<DataPoint *> > results;
+		std::vector< std::vector<double> > distances;
+		for (unsigned int block = begin; block < end; block++) {
+			unsigned int first = block * SPHERICAL_BLOCK_SIZE;
+			unsigned int rows = (points.size() - first < SPHERICAL_BLOCK_SIZE) ? points.size() - first : SPHERICAL_BLOCK_SIZE;
+			queries.assign(points.begin() + first, points.begin() + first + rows);
+			centroidIndex->findNearestNeighborsBatch(queries, 1, results, distances);
+
+			for (unsigned int r = 0; r < rows; r++) {
+				if (centroidPoint[first + r]) {
+					continue;
+				}
 
+				const double *x = &unitPoints[(first + r) * dimensions];
+				if (results[r].size() > 0) {
+					// Keep the current centroid if the candidate is not closer, so that
+					// the objective never gets worse and the assignments settle
+					int candidate = results[r][0] - &centroidCopies[0];
+					int current = clusterOfPoint[first + r];
+					if (current >= 0 && current != candidate) {
+						const double *candidateCentroid = &unitCentroids[candidate * dimensions];
+						const double *currentCentroid = &unitCentroids[current * dimensions];
+						double candidateProduct = 0.0;
+						double currentProduct = 0.0;
+						for (unsigned int t = 0; t < dimensions; t++) {
+							candidateProduct += x[t] * candidateCentroid[t];
+							currentProduct += x[t] * currentCentroid[t];
+						}
+						if (candidateProduct <= currentProduct) {
+							candidate = current;
+						}
+					}
+					clusterOfPoint[first + r] = candidate;
+					continue;
+				}
 
-	// Create the sum for every cluster
-	for (unsigned int i = 0; i < clusters.size(); i++) {
-		for (unsigned int j = 0; j < clusters[i].size(); j++) {
-			newCentroids[i]->add(*(clusters[i][j]));
+				// Empty buckets: check every centroid
+				int maxIndex = 0;
+				double maxProduct = 0.0;
+				for (unsigned int j = 0; j < k; j++) {
+					const double *centroid = &unitCentroids[j * dimensions];
+					double product = 0.0;
+					for (unsigned int t = 0; t < dimensions; t++) {
+						product += x[t] * centroid[t];
+					}
+					if (j == 0 || product > maxProduct) {
+						maxProduct = product;
+						maxIndex = j;
+					}
+				}
+				clusterOfPoint[first + r] = maxIndex;
+			}
 		}
+	});
+}
+
+
+
+/* Create the list of points of every cluster with counting sort (in the order of the points) */
+void KMeansClustering::buildClusters() {
+	clusterStart.assign(numberOfClusters + 1, 0);
+	for (unsigned int i = 0; i < points.size(); i++) {
+		if (!centroidPoint[i] && clusterOfPoint[i] >= 0) {
+			clusterStart[clusterOfPoint[i] + 1]++;
+		}
+	}
+	for (int j = 0; j < numberOfClusters; j++) {
+		clusterStart[j + 1] += clusterStart[j];
 	}
 
-	// Create the mean point by dividing by number of points for each cluster
-	for (unsigned int i = 0; i < clusters.size(); i++) {
-		if (clusters[i].size() > 0) {
-			newCentroids[i]->divide(clusters[i].size());
+	members.resize(clusterStart[numberOfClusters]);
+	std::vector<unsigned int> position(clusterStart.begin(), clusterStart.end() - 1);
+	for (unsigned int i = 0; i < points.size(); i++) {
+		if (!centroidPoint[i] && clusterOfPoint[i] >= 0) {
+			members[position[clusterOfPoint[i]]++] = points[i];
 		}
 	}
+}
+
+
+
+/* Start the next run from the given centroids and (optionally) the cluster of every point */
+void KMeansClustering::setInitialCentroids(const std::vector<DataPoint>& centroidsArg, const std::vector<int>& assignments) {
+	if (centroidsArg.size() != (unsigned int) numberOfClusters) {
+		std::cerr << "Invalid number of initial centroids: " << centroidsArg.size() << ". Number of clusters: " << numberOfClusters << std::endl;
+		return;
+	}
+	startCentroids = centroidsArg;
+	startAssignments = assignments;
+}
+
+
+
+/* Get the cluster of every point (-1 for points that are not assigned) */
+void KMeansClustering::getAssignments(std::vector<int>& result) const {
+	result = clusterOfPoint;
+}
+
+
+
+/* Index of a dataset point (-1 if the point is not part of the dataset).
+ * The points are the elements of the input vector, so they are contiguous */
+int KMeansClustering::pointIndex(const DataPoint *p) const {
+	if (points.size() > 0 && p >= points[0] && p <= points.back()) {
+		return p - points[0];
+	}
+	return -1;
+}
+
+
+
+/* Assign each point to the closest centroid using Hamerly's bounds:
+ * a point keeps its centroid without computing any distances if its upper bound
+ * is smaller than both its lower bound and half the distance of its centroid
+ * from the closest other centroid */
+void BoundedKMeans::assign() {
+	unsigned int k = centroids.size();
+	if (boundsValid.size() != points.size()) {
+		boundsValid.assign(points.size(), false);
+		upperBounds.assign(points.size(), 0.0);
+		lowerBounds.assign(points.size(), 0.0);
+	}
+
+	// Find how much every centroid moved since the last assignment
+	std::vector<double> moved(k, 0.0);
+	int maxMovedIndex = -1;
+	double maxMoved = 0.0;
+	double secondMaxMoved = 0.0;
+	if (previousCentroids.size() == k) {
+		for (unsigned int j = 0; j < k; j++) {
+			moved[j] = distFun(previousCentroids[j], *centroids[j]);
+			if (moved[j] > maxMoved) {
+				secondMaxMoved = maxMoved;
+				maxMoved = moved[j];
+				maxMovedIndex = j;
+			} else if (moved[j] > secondMaxMoved) {
+				secondMaxMoved = moved[j];
+			}
+		}
+	}
+	previousCentroids.clear();
+	for (unsigned int j = 0; j < k; j++) {
+		previousCentroids.push_back(*centroids[j]);
+	}
+
+	// Half the distance of every centroid from its closest centroid
+	std::vector<double> halfClosest(k, -1.0);
+	pool->parallelFor(k, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int j = begin; j < end; j++) {
+			for (unsigned int m = 0; m < k; m++) {
+				if (m == j) {
+					continue;
+				}
+				double half = distFun(*centroids[j], *centroids[m]) / 2;
+				if (half < halfClosest[j] || halfClosest[j] < 0) {
+					halfClosest[j] = half;
+				}
+			}
+		}
+	});
+
+
+	pool->parallelFor(points.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			if (centroidPoint[i]) {
+				continue;
+			}
+
+			bool search = true;
+			if (boundsValid[i]) {
+				// Loosen the bounds by the movement of the centroids
+				int current = clusterOfPoint[i];
+				upperBounds[i] += moved[current];
+				lowerBounds[i] -= (current == maxMovedIndex) ? secondMaxMoved : maxMoved;
+
+				double bound = (halfClosest[current] > lowerBounds[i]) ? halfClosest[current] : lowerBounds[i];
+				if (upperBounds[i] <= bound) {
+					search = false;
+				} else {
+					// Tighten the upper bound and check again
+					upperBounds[i] = distFun(*points[i], *centroids[current]);
+					search = (upperBounds[i] > bound);
+				}
+			}
+
+			if (search) {
+				// Find the closest and second closest centroid
+				int minIndex = -1;
+				double minDist = -1.0;
+				double secondMinDist = -1.0;
+				for (unsigned int j = 0; j < k; j++) {
+					double dist = distFun(*points[i], *centroids[j]);
+					if (dist < minDist || minIndex < 0) {
+						secondMinDist = minDist;
+						minDist = dist;
+						minIndex = j;
+					} else if (dist < secondMinDist || secondMinDist < 0) {
+						secondMinDist = dist;
+					}
+				}
+
+				clusterOfPoint[i] = minIndex;
+				upperBounds[i] = minDist;
+				lowerBounds[i] = secondMinDist;
+				boundsValid[i] = true;
+			}
+		}
+	});
+}
+
+
+
+/* Set the new centroid of each cluster as the mean of its points */
+unsigned int KMeansClustering::update() {
+	unsigned int k = centroids.size();
+	unsigned int dimensions = points[0]->getDimensions();
+
+	// Every chunk of points sums its own points to its part of the buffers.
+	// The chunks are summed in order so the result doesn't depend on the scheduling
+	unsigned int chunks = pool->size();
+	partialSums.assign(chunks * k * dimensions, 0.0);
+	partialCounts.assign(chunks * k, 0);
+	pool->parallelFor(chunks, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int c = begin; c < end; c++) {
+			unsigned int first = (unsigned long) points.size() * c / chunks;
+			unsigned int last = (unsigned long) points.size() * (c + 1) / chunks;
+			for (unsigned int i = first; i < last; i++) {
+				int cluster = clusterOfPoint[i];
+				if (centroidPoint[i] || cluster < 0) {
+					continue;
+				}
+
+				double *sum = &partialSums[(c * k + cluster) * dimensions];
+				if (spherical) { // Sum the unit vectors
+					const double *x = &unitPoints[i * dimensions];
+					for (unsigned int t = 0; t < dimensions; t++) {
+						sum[t] += x[t];
+					}
+				} else {
+					for (unsigned int t = 0; t < dimensions; t++) {
+						sum[t] += points[i]->at(t);
+					}
+				}
+				partialCounts[c * k + cluster]++;
+			}
+		}
+	});
+
+	// Reduce the sums to the buffers of the first chunk and create the mean of every cluster
+	pool->parallelFor(k, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int j = begin; j < end; j++) {
+			double *mean = &partialSums[j * dimensions];
+			unsigned int count = partialCounts[j];
+			for (unsigned int c = 1; c < chunks; c++) {
+				const double *sum = &partialSums[(c * k + j) * dimensions];
+				for (unsigned int t = 0; t < dimensions; t++) {
+					mean[t] += sum[t];
+				}
+				count += partialCounts[c * k + j];
+			}
+
+			if (spherical) { // Unit vector in the direction of the sum
+				normalizeRow(mean, dimensions);
+			} else if (count > 0) {
+				for (unsigned int t = 0; t < dimensions; t++) {
+					mean[t] /= count;
+				}
+			}
+			partialCounts[j] = count;
+		}
+	});
 
 
 	// Create the new centroids if they are different
+	if (spareCentroids.size() != k) {
+		spareCentroids.assign(k, NULL);
+	}
 	unsigned int changesMade = 0;
-	for (unsigned int i = 0; i < clusters.size(); i++) {
-		if (clusters[i].size() == 0) { // Empty cluster
-			delete newCentroids[i];
+	for (unsigned int i = 0; i < k; i++) {
+		if (partialCounts[i] == 0) { // Empty cluster
 			continue;
 		}
 
-		if (!newCentroids[i]->equal(*centroids[i])) { // Centroid changed
+		// Reuse the buffer of a previous centroid for the new one
+		if (spareCentroids[i] == NULL) {
+			spareCentroids[i] = new DataPoint(std::vector<double>(dimensions, 0.0), "dummy");
+		}
+		DataPoint *newCentroid = spareCentroids[i];
+		newCentroid->assign(&partialSums[i * dimensions]);
+
+		if (!newCentroid->equal(*centroids[i])) { // Centroid changed
 			if (centroids[i]->getID() == "dummy") { // The previous centroid was a new point
-				delete centroids[i];
+				spareCentroids[i] = centroids[i];
 			} else { // The previous centroid is part of the dataset
 				// Place the old centroid back in the cluster
-				clusters[i].push_back(centroids[i]);
+				int index = pointIndex(centroids[i]);
+				centroidPoint[index] = false;
+				releaseCentroidPoint(index);
+				spareCentroids[i] = NULL;
 			}
-			centroids[i] = newCentroids[i];
-			clusterOfPoint[centroids[i]->getID()] = i;
+			centroids[i] = newCentroid;
 			changesMade++;
-		} else {
-			delete newCentroids[i]; // Not needed any more
 		}
 	}
 
@@ -123,97 +697,490 @@ unsigned int KMeansClustering::update() {
 
 
 
-int KMeansClustering::run() {
-	int numberOfLoops = 0;
-	initialize();
-	unsigned int changes = 0;
-	do {
-		resetClusters();
+/* Mini-batch K-means: move the centroids towards small random samples of the points
+ * instead of averaging every point in each iteration. Only the final assignment
+ * depends on the number of points */
+int KMeansClustering::runMiniBatch() {
+	unsigned int dimensions = points[0]->getDimensions();
+	unsigned int k = numberOfClusters;
 
-		assign();
-		changes = update();
-		numberOfLoops++;
-	} while (changes > 0 && (unsigned int) numberOfLoops < LOOP_LIMIT);
+	// Pick the initial centroids from a sample of the points
+	unsigned int sampleSize = MINI_BATCH_INIT_FACTOR * ((miniBatchSize > k) ? miniBatchSize : k);
+	if (sampleSize < points.size()) {
+		std::vector<DataPoint *> allPoints;
+		allPoints.swap(points);
 
-	return numberOfLoops;
+		std::unordered_set<unsigned int> sampled;
+		std::uniform_int_distribution<unsigned int> uniform(0, allPoints.size() - 1);
+		while (points.size() < sampleSize) {
+			unsigned int index = uniform(generator);
+			if (sampled.insert(index).second) {
+				points.push_back(allPoints[index]);
+			}
+		}
+
+		initialize();
+		points.swap(allPoints);
+	} else {
+		initialize();
+	}
+	clusterOfPoint.assign(points.size(), -1);
+	centroidPoint.assign(points.size(), false);
+
+	// The centroids move, so they can't be points of the dataset
+	std::vector<double> centers(k * dimensions);
+	for (unsigned int j = 0; j < k; j++) {
+		std::vector<double> coordinates = centroids[j]->getVector();
+		std::copy(coordinates.begin(), coordinates.end(), centers.begin() + j * dimensions);
+		centroids[j] = new DataPoint(coordinates, "dummy");
+	}
+	// Number of points that moved every centroid so far
+	std::vector<unsigned int> counts(k, 0);
+
+
+	std::vector<unsigned int> batch(miniBatchSize);
+	std::vector<int> batchCluster(miniBatchSize);
+	std::vector<double> previousCenters;
+	std::uniform_int_distribution<unsigned int> uniform(0, points.size() - 1);
+	unsigned int iterations = 0;
+	unsigned int stableIterations = 0;
+	while (iterations < miniBatchIterations && stableIterations < MINI_BATCH_PATIENCE) {
+		for (unsigned int b = 0; b < miniBatchSize; b++) {
+			batch[b] = uniform(generator);
+		}
+
+		// Find the closest centroid of every point in the batch before moving any centroid
+		pool->parallelFor(miniBatchSize, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int b = begin; b < end; b++) {
+				double minDist = -1.0;
+				batchCluster[b] = points[batch[b]]->findNearest(centroids, minDist, distFun);
+			}
+		});
+
+		// Move every centroid towards the points of the batch assigned to it
+		previousCenters = centers;
+		double rate = initialRate / (1 + rateDecay * iterations);
+		for (unsigned int b = 0; b < miniBatchSize; b++) {
+			int cluster = batchCluster[b];
+			counts[cluster]++;
+			if (learningRate == COUNT_LEARNING_RATE) {
+				rate = 1.0 / counts[cluster];
+			}
+
+			double *center = &centers[cluster * dimensions];
+			if (spherical) {
+				const double *x = &unitPoints[batch[b] * dimensions];
+				for (unsigned int t = 0; t < dimensions; t++) {
+					center[t] += rate * (x[t] - center[t]);
+				}
+			} else {
+				for (unsigned int t = 0; t < dimensions; t++) {
+					center[t] += rate * (points[batch[b]]->at(t) - center[t]);
+				}
+			}
+		}
+		if (spherical) {
+			for (unsigned int j = 0; j < k; j++) {
+				normalizeRow(&centers[j * dimensions], dimensions);
+			}
+		}
+
+		// Mean squared movement of the centroids
+		double movement = 0.0;
+		for (unsigned int t = 0; t < centers.size(); t++) {
+			movement += (centers[t] - previousCenters[t]) * (centers[t] - previousCenters[t]);
+		}
+		movement /= k;
+
+		for (unsigned int j = 0; j < k; j++) {
+			centroids[j]->assign(&centers[j * dimensions]);
+		}
+
+		iterations++;
+		if (movement <= miniBatchTolerance) {
+			stableIterations++;
+		} else {
+			stableIterations = 0;
+		}
+	}
+
+	// Assign every point to its closest centroid
+	assign();
+
+	return iterations;
 }
 
 
-bool KMeansClustering::isCentroid(const DataPoint *x) const {
-	for (unsigned int i = 0; i < centroids.size(); i++) {
-		if (x->getID() == centroids[i]->getID()) {
-			return true;
+
+/* Start from the given centroids. If the previous assignments are given
+ * too, move the centroids to the means of the previous clusters first */
+void KMeansClustering::warmStart() {
+	for (int j = 0; j < numberOfClusters; j++) {
+		centroids.push_back(new DataPoint(startCentroids[j].getVector(), "dummy"));
+	}
+
+	if (startAssignments.size() == points.size()) {
+		for (unsigned int i = 0; i < points.size(); i++) {
+			if (startAssignments[i] < numberOfClusters) {
+				clusterOfPoint[i] = startAssignments[i];
+			}
 		}
+		update();
+	}
+}
+
+
+
+/* 2-means on the points with the given indices using the given number of threads.
+ * The cost of every half is the sum of the squared distances from its centroid.
+ * Returns false if the points can't be split in two non empty clusters */
+bool BisectingKMeans::split(const std::vector<unsigned int>& indices, unsigned int splitThreads, std::vector<unsigned int>& left,
+		std::vector<unsigned int>& right, DataPoint& leftCentroid, DataPoint& rightCentroid, double& leftCost, double& rightCost) const {
+	std::vector<DataPoint> subset;
+	subset.reserve(indices.size());
+	for (unsigned int i = 0; i < indices.size(); i++) {
+		subset.push_back(*points[indices[i]]);
 	}
 
-	return false;
+	KMeansClustering *twoMeans = spherical ? new SphericalKMeans(subset, 2) : new KMeansClustering(subset, 2);
+	twoMeans->setInitialization(KMEANS_PP_INIT);
+	twoMeans->setThreads(splitThreads);
+	twoMeans->run();
+
+	std::vector<int> assignments;
+	twoMeans->getAssignments(assignments);
+	// The centroids are deleted with the 2-means object
+	std::vector<DataPoint *> halves = twoMeans->getCentroids();
+	left.clear();
+	right.clear();
+	leftCost = 0.0;
+	rightCost = 0.0;
+	for (unsigned int i = 0; i < indices.size(); i++) {
+		double dist = distFun(subset[i], *halves[assignments[i] == 1 ? 1 : 0]);
+		if (assignments[i] == 1) {
+			right.push_back(indices[i]);
+			rightCost += dist * dist;
+		} else {
+			left.push_back(indices[i]);
+			leftCost += dist * dist;
+		}
+	}
+	bool separated = !left.empty() && !right.empty();
+	if (separated) {
+		leftCentroid = DataPoint(halves[0]->getVector(), "dummy");
+		rightCentroid = DataPoint(halves[1]->getVector(), "dummy");
+	}
+	delete twoMeans;
+	return separated;
 }
 
 
-/* Set current cluster for every non-centroid point to -1
- * (Called before assignment step to reassign the points to new clusters) */
-void KMeansClustering::resetClusters() {
+
+/* Bisecting K-means: split the cluster whose split lowers the cost the most with 2-means
+ * until there are k clusters or every cluster is smaller than the minimum split size.
+ * The 2-means of every new cluster are computed in parallel in rounds, sharing the threads.
+ * A round accepts the splits in order of their gain while the gain isn't smaller than the
+ * cost of a cluster created in the same round (the largest gain that cluster could have),
+ * so the result is the same as splitting one cluster at a time. Returns the number of rounds */
+int BisectingKMeans::run() {
+	unsigned int k = numberOfClusters;
+	unsigned int dimensions = points[0]->getDimensions();
+	unsigned int minSize = (minSplitSize > 3) ? minSplitSize : 3;
+	pool = new ThreadPool(threads);
+	clusterOfPoint.assign(points.size(), -1);
+	centroidPoint.assign(points.size(), false);
+
+	// The root holds every point. Only the leaves keep their points
+	tree.clear();
+	tree.push_back(TreeNode{DataPoint(), -1, -1, -1});
+	std::vector< std::vector<unsigned int> > nodePoints(1, std::vector<unsigned int>(points.size()));
 	for (unsigned int i = 0; i < points.size(); i++) {
-		if (!isCentroid(points[i])) {
-			clusterOfPoint[points[i]->getID()] = -1;
+		nodePoints[0][i] = i;
+	}
+	std::vector<double> nodeCost(1, 0.0);
+
+	// 2-means of every leaf (computed once)
+	std::vector< std::vector<unsigned int> > leftPoints(1);
+	std::vector< std::vector<unsigned int> > rightPoints(1);
+	std::vector<DataPoint> leftCentroids(1);
+	std::vector<DataPoint> rightCentroids(1);
+	std::vector<double> leftCosts(1);
+	std::vector<double> rightCosts(1);
+
+	std::vector<int> leaves(1, 0); // Leaves that may be split
+	std::vector<int> unsplit(1, 0); // Leaves whose 2-means isn't computed yet
+	unsigned int numberOfLeaves = 1;
+	int rounds = 0;
+	while (numberOfLeaves < k) {
+		unsigned int splitThreads = (pool->size() > unsplit.size()) ? pool->size() / unsplit.size() : 1;
+		std::vector<char> splitDone(unsplit.size());
+		pool->parallelFor(unsplit.size(), [&](unsigned int begin, unsigned int end) {
+			for (unsigned int s = begin; s < end; s++) {
+				int node = unsplit[s];
+				if (nodePoints[node].size() >= minSize) {
+					splitDone[s] = split(nodePoints[node], splitThreads, leftPoints[node], rightPoints[node],
+							leftCentroids[node], rightCentroids[node], leftCosts[node], rightCosts[node]);
+				}
+			}
+		});
+		for (unsigned int s = 0; s < unsplit.size(); s++) {
+			if (splitDone[s]) {
+				leaves.push_back(unsplit[s]);
+			}
+		}
+		unsplit.clear();
+		if (leaves.empty()) {
+			break;
+		}
+
+		// Largest gain first
+		std::vector<double> gain(tree.size(), 0.0);
+		for (unsigned int l = 0; l < leaves.size(); l++) {
+			int node = leaves[l];
+			gain[node] = nodeCost[node] - leftCosts[node] - rightCosts[node];
+		}
+		std::sort(leaves.begin(), leaves.end(), [&](int a, int b) {
+			return gain[a] > gain[b];
+		});
+
+		double bound = 0.0; // Largest cost of a cluster created in this round
+		unsigned int accepted = 0;
+		while (accepted < leaves.size() && numberOfLeaves < k && (accepted == 0 || gain[leaves[accepted]] >= bound)) {
+			int node = leaves[accepted];
+			int child = tree.size();
+			tree.push_back(TreeNode{leftCentroids[node], -1, -1, -1});
+			tree.push_back(TreeNode{rightCentroids[node], -1, -1, -1});
+			tree[node].left = child;
+			tree[node].right = child + 1;
+
+			nodePoints.resize(tree.size());
+			nodePoints[child].swap(leftPoints[node]);
+			nodePoints[child + 1].swap(rightPoints[node]);
+			std::vector<unsigned int>().swap(nodePoints[node]);
+			nodeCost.push_back(leftCosts[node]);
+			nodeCost.push_back(rightCosts[node]);
+			bound = std::max(bound, std::max(leftCosts[node], rightCosts[node]));
+
+			unsplit.push_back(child);
+			unsplit.push_back(child + 1);
+			numberOfLeaves++;
+			accepted++;
+		}
+		leaves.erase(leaves.begin(), leaves.begin() + accepted);
+
+		leftPoints.resize(tree.size());
+		rightPoints.resize(tree.size());
+		leftCentroids.resize(tree.size());
+		rightCentroids.resize(tree.size());
+		leftCosts.resize(tree.size());
+		rightCosts.resize(tree.size());
+		rounds++;
+	}
+
+	// Every leaf is a cluster with the mean of its points as the centroid
+	std::vector<int> clusterLeaves;
+	for (unsigned int node = 0; node < tree.size(); node++) {
+		if (tree[node].left < 0) {
+			clusterLeaves.push_back(node);
 		}
 	}
+	numberOfClusters = clusterLeaves.size();
+	for (unsigned int j = 0; j < clusterLeaves.size(); j++) {
+		const std::vector<unsigned int>& leafPoints = nodePoints[clusterLeaves[j]];
+		std::vector<double> mean(dimensions, 0.0);
+		for (unsigned int i = 0; i < leafPoints.size(); i++) {
+			const DataPoint *p = points[leafPoints[i]];
+			// Spherical K-means sums the unit vectors
+			double scale = (spherical && p->getNorm() > 0.0) ? 1.0 / p->getNorm() : 1.0;
+			for (unsigned int t = 0; t < dimensions; t++) {
+				mean[t] += scale * p->at(t);
+			}
+			clusterOfPoint[leafPoints[i]] = j;
+		}
+		if (spherical) {
+			normalizeRow(&mean[0], dimensions);
+		} else if (leafPoints.size() > 0) {
+			for (unsigned int t = 0; t < dimensions; t++) {
+				mean[t] /= leafPoints.size();
+			}
+		}
 
-	for (unsigned int i = 0; i < clusters.size(); i++) {
-		clusters[i].clear();
+		centroids.push_back(new DataPoint(mean, "dummy"));
+		tree[clusterLeaves[j]].centroid = *centroids.back();
+		tree[clusterLeaves[j]].cluster = j;
 	}
+	buildClusters();
+
+	delete pool;
+	pool = NULL;
+	return rounds;
 }
 
 
 
+int KMeansClustering::run() {
+	pool = new ThreadPool(threads);
+	if (spherical && unitPoints.size() != points.size() * points[0]->getDimensions()) {
+		// Normalize the points once
+		unsigned int dimensions = points[0]->getDimensions();
+		unitPoints.resize(points.size() * dimensions);
+		pool->parallelFor(points.size(), [&](unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; i++) {
+				for (unsigned int t = 0; t < dimensions; t++) {
+					unitPoints[i * dimensions + t] = points[i]->at(t);
+				}
+				normalizeRow(&unitPoints[i * dimensions], dimensions);
+			}
+		});
+	}
+	clusterOfPoint.assign(points.size(), -1);
+	centroidPoint.assign(points.size(), false);
+
+	int numberOfLoops = 0;
+	if (miniBatchSize > 0) {
+		numberOfLoops = runMiniBatch();
+	} else {
+		if (startCentroids.size() == (unsigned int) numberOfClusters) {
+			warmStart();
+		} else {
+			initialize();
+		}
+		unsigned int changes = 0;
+		do {
+			assign();
+			changes = update();
+			numberOfLoops++;
+		} while (changes > 0 && (unsigned int) numberOfLoops < LOOP_LIMIT);
+	}
+
+	buildClusters();
+
+	delete pool;
+	pool = NULL;
+	return numberOfLoops;
+}
+
+
+unsigned long KMeansClustering::estimateMemory(unsigned int n, unsigned int d, unsigned int k, unsigned int threads) {
+	// Point pointer, cluster, flags, bounds and cluster lists for every point
+	unsigned long perPoint = 2 * sizeof(DataPoint *) + sizeof(int) + 2 * sizeof(char) + 2 * sizeof(double) + sizeof(unsigned int);
+	// Centroids, spare and previous centroids and the partial sums of every chunk
+	unsigned long perCentroid = (3 + threads) * (sizeof(DataPoint) + d * sizeof(double));
+	return n * perPoint + k * perCentroid;
+}
+
+
+
+/* Exact silhouette: O(n^2) distance calculations */
 double KMeansClustering::silhouette(std::vector<double>& clusterSilhouette) const {
+	return averageSilhouette(members, clusterStart, points.size(), [&](const DataPoint *p) {
+		return silhouetteOfPoint(p, members, clusterStart);
+	}, clusterSilhouette);
+}
+
+
+
+/* Silhouette of a random sample of the points, using only the sampled points
+ * as the points of the clusters: O(sampleSize^2) distance calculations */
+double KMeansClustering::sampledSilhouette(std::vector<double>& clusterSilhouette, unsigned int sampleSize, unsigned int seed) const {
+	if (sampleSize >= members.size()) {
+		return silhouette(clusterSilhouette);
+	}
+
+	// Pick the sample with a partial shuffle (same sample for the same seed)
+	std::default_random_engine sampleGenerator(seed);
+	std::vector<unsigned int> indices(members.size());
+	for (unsigned int i = 0; i < indices.size(); i++) {
+		indices[i] = i;
+	}
+	for (unsigned int i = 0; i < sampleSize; i++) {
+		std::uniform_int_distribution<unsigned int> uniform(i, indices.size() - 1);
+		std::swap(indices[i], indices[uniform(sampleGenerator)]);
+	}
+	// The members are sorted by cluster, so the sorted sample is sorted by cluster too
+	std::sort(indices.begin(), indices.begin() + sampleSize);
+
+	std::vector<DataPoint *> sample(sampleSize);
+	std::vector<unsigned int> sampleStart(numberOfClusters + 1, 0);
+	for (unsigned int i = 0; i < sampleSize; i++) {
+		sample[i] = members[indices[i]];
+		sampleStart[clusterOfPoint[pointIndex(sample[i])] + 1]++;
+	}
+	for (int j = 0; j < numberOfClusters; j++) {
+		sampleStart[j + 1] += sampleStart[j];
+	}
+
+	return averageSilhouette(sample, sampleStart, sampleSize, [&](const DataPoint *p) {
+		return silhouetteOfPoint(p, sample, sampleStart);
+	}, clusterSilhouette);
+}
+
+
+
+/* Simplified silhouette: use the distances from the centroids instead of
+ * the average distances from the points of the clusters: O(n * k) */
+double KMeansClustering::simplifiedSilhouette(std::vector<double>& clusterSilhouette) const {
+	return averageSilhouette(members, clusterStart, points.size(), [&](const DataPoint *p) {
+		int clusterIndex = clusterOfPoint[pointIndex(p)];
+		double a = distFun(*p, *centroids[clusterIndex]);
+		double b = 0.0;
+		secondClosestCluster(p, clusterIndex, b);
+
+		double max = ((a > b) ? a : b);
+		if (max == 0) {
+			return 0.0;
+		}
+		return (b - a) / max;
+	}, clusterSilhouette);
+}
+
+
+
+/* Calculate the silhouette of the given points (sorted by cluster) in parallel
+ * and return the average of every cluster and the sum divided by total */
+double KMeansClustering::averageSilhouette(const std::vector<DataPoint *>& subset, const std::vector<unsigned int>& subsetStart, unsigned int total,
+		const std::function<double(const DataPoint *)>& silhouetteFun, std::vector<double>& clusterSilhouette) const {
+	std::vector<double> pointSilhouette(subset.size());
+	ThreadPool silhouettePool(threads);
+	silhouettePool.parallelFor(subset.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			pointSilhouette[i] = silhouetteFun(subset[i]);
+		}
+	});
+
+
 	clusterSilhouette.clear();
-	for (unsigned int i = 0; i < clusters.size(); i++) {
+	for (int i = 0; i < numberOfClusters; i++) {
 		clusterSilhouette.push_back(0.0);
 	}
 	double totalSilhouette = 0.0;
 
-
-	for (unsigned int i = 0; i < clusters.size(); i++) {
-		for (unsigned int j = 0; j < clusters[i].size(); j++) {
-			double result = silhouetteOfPoint(clusters[i][j]);
-			clusterSilhouette[i] += result;
-			totalSilhouette += result;
+	for (int i = 0; i < numberOfClusters; i++) {
+		for (unsigned int j = subsetStart[i]; j < subsetStart[i + 1]; j++) {
+			clusterSilhouette[i] += pointSilhouette[j];
+			totalSilhouette += pointSilhouette[j];
 		}
 	}
 
 
 	// Calculate average silhouette for every cluster
-	for (unsigned int i = 0; i < clusters.size(); i++) {
-		if (clusters[i].size() > 0) {
-			clusterSilhouette[i] /= (clusters[i].size());
+	for (int i = 0; i < numberOfClusters; i++) {
+		if (subsetStart[i + 1] > subsetStart[i]) {
+			clusterSilhouette[i] /= (subsetStart[i + 1] - subsetStart[i]);
 		}
 	}
 
 	// Return average silhouette of all points
-	if (points.size() > 0) {
-		return totalSilhouette / points.size();
+	if (total > 0) {
+		return totalSilhouette / total;
 	} else {
 		return 0;
 	}
 }
 
 
-double KMeansClustering::silhouetteOfPoint(const DataPoint *p) const {
-	// Calculate average distance of p to other points in same cluster
-	int clusterIndex = clusterOfPoint.at(p->getID());
-	double sum = 0.0;
-	unsigned int pointsInCluster = clusters[clusterIndex].size();
-	for (unsigned int i = 0; i < clusters[clusterIndex].size(); i++) {
-		sum += distFun(*p, *(clusters[clusterIndex][i]));
-	}
-	double a = 0.0;
-	if (pointsInCluster > 0) {
-		a = sum / pointsInCluster;
-	}
-
-
-	// Find second closest cluster
+/* Find the closest centroid to p other than the centroid of its cluster */
+int KMeansClustering::secondClosestCluster(const DataPoint *p, int clusterIndex, double& minDist) const {
 	std::vector<DataPoint *> otherCentroids;
 	std::vector<int> indices;
 	for (unsigned int i = 0; i < centroids.size(); i++) {
@@ -225,15 +1192,35 @@ double KMeansClustering::silhouetteOfPoint(const DataPoint *p) const {
 		indices.push_back(i);
 	}
 
-	double minDist = 0.0;
 	int minIndex = p->findNearest(otherCentroids, minDist, distFun);
-	int minCluster = indices[minIndex];
+	return indices[minIndex];
+}
+
+
+/* Silhouette of p using the given points (sorted by cluster) as the points of each cluster */
+double KMeansClustering::silhouetteOfPoint(const DataPoint *p, const std::vector<DataPoint *>& subset, const std::vector<unsigned int>& subsetStart) const {
+	// Calculate average distance of p to other points in same cluster
+	int clusterIndex = clusterOfPoint[pointIndex(p)];
+	double sum = 0.0;
+	unsigned int pointsInCluster = subsetStart[clusterIndex + 1] - subsetStart[clusterIndex];
+	for (unsigned int i = subsetStart[clusterIndex]; i < subsetStart[clusterIndex + 1]; i++) {
+		sum += distFun(*p, *subset[i]);
+	}
+	double a = 0.0;
+	if (pointsInCluster > 0) {
+		a = sum / pointsInCluster;
+	}
+
+
+	// Find second closest cluster
+	double minDist = 0.0;
+	int minCluster = secondClosestCluster(p, clusterIndex, minDist);
 
 	// Calculate average distance of p to other points in second closest cluster
 	sum = 0.0;
-	pointsInCluster = clusters[minCluster].size();
-	for (unsigned int i = 0; i < clusters[minCluster].size(); i++) {
-		sum += distFun(*p, *(clusters[minCluster][i]));
+	pointsInCluster = subsetStart[minCluster + 1] - subsetStart[minCluster];
+	for (unsigned int i = subsetStart[minCluster]; i < subsetStart[minCluster + 1]; i++) {
+		sum += distFun(*p, *subset[i]);
 	}
 	double b = 0.0;
 	if (pointsInCluster > 0) {
@@ -250,8 +1237,8 @@ double KMeansClustering::silhouetteOfPoint(const DataPoint *p) const {
 
 void KMeansClustering::getNumberOfPointsPerCluster(std::vector<unsigned int>& result) const {
 	result.clear();
-	for (unsigned int i = 0; i < clusters.size(); i++) {
-		result.push_back(clusters[i].size());
+	for (int i = 0; i < numberOfClusters; i++) {
+		result.push_back(clusterStart[i + 1] - clusterStart[i]);
 	}
 }
 
@@ -260,19 +1247,101 @@ void KMeansClustering::getNumberOfPointsPerCluster(std::vector<unsigned int>& re
 void KMeansClustering::getPointsPerCluster(std::vector< std::vector< std::string> >& results) const {
 	results.clear();
 
-	for (unsigned int i = 0; i < clusters.size(); i++) {
+	for (int i = 0; i < numberOfClusters; i++) {
 		results.push_back(std::vector<std::string>());
-		for (unsigned int j = 0; j < clusters[i].size(); j++) {
-			results[i].push_back(clusters[i][j]->getID());
+		for (unsigned int j = clusterStart[i]; j < clusterStart[i + 1]; j++) {
+			results[i].push_back(members[j]->getID());
 		}
 	}
 }
 
 
 std::vector<DataPoint *> KMeansClustering::getPointsInSameCluster(const DataPoint& p) const {
-	if (clusterOfPoint.find(p.getID()) == clusterOfPoint.end()) {
+	int index = pointIndex(&p);
+	if (index < 0) { // Not a dataset point: find a point with the same ID
+		for (unsigned int i = 0; i < points.size(); i++) {
+			if (points[i]->getID() == p.getID()) {
+				index = i;
+				break;
+			}
+		}
+	}
+
+	if (index < 0) {
+		std::vector<DataPoint *> empty;
+		return empty;
+	}
+	return getPointsInSameCluster(index);
+}
+
+
+/* Get the points in the same cluster as the point with the given index in the dataset */
+std::vector<DataPoint *> KMeansClustering::getPointsInSameCluster(unsigned int index) const {
+	if (index >= clusterOfPoint.size() || clusterOfPoint[index] < 0) {
 		std::vector<DataPoint *> empty;
 		return empty;
 	}
-	return clusters[clusterOfPoint.at(p.getID())];
+
+	int cluster = clusterOfPoint[index];
+	return std::vector<DataPoint *>(members.begin() + clusterStart[cluster], members.begin() + clusterStart[cluster + 1]);
+}
+
+
+/* Find the cluster with the closest centroid to a point that isn't part of the clustering: O(k * d) */
+int KMeansClustering::nearestCluster(const DataPoint& query) const {
+	double minDist = -1.0;
+	return query.findNearest(centroids, minDist, distFun);
+}
+
+
+
+/* Follow the closer child from the root of the tree: O(d * log k) */
+int BisectingKMeans::nearestCluster(const DataPoint& query) const {
+	if (tree.size() <= 1) {
+		return KMeansClustering::nearestCluster(query);
+	}
+
+	int node = 0;
+	while (tree[node].left >= 0) {
+		int left = tree[node].left;
+		int right = tree[node].right;
+		node = (distFun(query, tree[left].centroid) <= distFun(query, tree[right].centroid)) ? left : right;
+	}
+	return tree[node].cluster;
+}
+
+
+/* Move the given points of the dataset (changed or added after the last one since run)
+ * to the cluster of the closest centroid. The centroids don't move.
+ * Returns false if the points aren't the elements of the input vector any more */
+bool KMeansClustering::updatePoints(std::vector<DataPoint>& inputPoints, const std::vector<unsigned int>& changed) {
+	if (clusterStart.size() == 0 || inputPoints.size() < points.size() || &inputPoints[0] != points[0]) {
+		return false;
+	}
+
+	for (unsigned int i = points.size(); i < inputPoints.size(); i++) {
+		points.push_back(&inputPoints[i]);
+		clusterOfPoint.push_back(-1);
+		centroidPoint.push_back(0);
+	}
+	for (unsigned int k = 0; k < changed.size(); k++) {
+		// A point used as a centroid moves its centroid with it
+		if (changed[k] < points.size() && !centroidPoint[changed[k]]) {
+			clusterOfPoint[changed[k]] = nearestCluster(*points[changed[k]]);
+		}
+	}
+	buildClusters();
+	return true;
+}
+
+
+/* Get the points of the cluster with the closest centroid to the query */
+std::vector<DataPoint *> KMeansClustering::assignNearest(const DataPoint& query) const {
+	int cluster = nearestCluster(query);
+	if (cluster < 0 || clusterStart.size() == 0) {
+		std::vector<DataPoint *> empty;
+		return empty;
+	}
+
+	return std::vector<DataPoint *>(members.begin() + clusterStart[cluster], members.begin() + clusterStart[cluster + 1]);
 }
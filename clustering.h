@@ -3,45 +3,143 @@
 
 #include <vector>
 #include <string>
-#include <unordered_map>
+#include <random>
+#include <functional>
 #include "data_point.h"
 #include "metrics.h"
+#include "LSH/LSH.h"
 
+class ThreadPool;
 
+/* K-means with Lloyd's iterations on the Euclidean metric: every point is assigned to
+ * the closest centroid by computing its distance from every centroid. The subclasses
+ * change the assignment step (or the whole algorithm) and the metric */
 class KMeansClustering {
-private:
+protected:
 	static const unsigned int LOOP_LIMIT = 50;
+	// k-means|| rounds and oversampling factor (candidates per round = factor * k)
+	static const unsigned int PARALLEL_INIT_ROUNDS = 5;
+	static const unsigned int PARALLEL_INIT_OVERSAMPLING = 2;
+	// Mini-batch K-means picks the initial centroids from (factor * batch size) points
+	static const unsigned int MINI_BATCH_INIT_FACTOR = 3;
+	// Consecutive iterations below the tolerance needed to stop
+	static const unsigned int MINI_BATCH_PATIENCE = 5;
 
 	DIST_PTR distFun;
+	bool spherical; // Cosine metric: K-means on unit vectors
+	int initMethod;
+	unsigned int threads;
+	std::default_random_engine generator;
+	ThreadPool *pool; // Exists while running
 
 	std::vector<DataPoint *> points;
 	std::vector<DataPoint *> centroids;
 	int numberOfClusters;
-	std::vector< std::vector<DataPoint *> > clusters;
 
-	// Map point ID to cluster index
-	std::unordered_map<std::string, int> clusterOfPoint;
+	// Dense bookkeeping indexed by the position of the point in the dataset
+	std::vector<int> clusterOfPoint; // Cluster of every point (-1 if not assigned yet)
+	std::vector<char> centroidPoint; // The point is the centroid of its cluster
+	// Points of every cluster (centroids excluded) sorted by cluster:
+	// cluster i has members [clusterStart[i], clusterStart[i + 1])
+	std::vector<DataPoint *> members;
+	std::vector<unsigned int> clusterStart;
+
+	// Normalized points of spherical K-means (row-major)
+	std::vector<double> unitPoints;
+
+	// Buffers of the update step reused in every iteration
+	std::vector<double> partialSums; // Sum of every chunk of points for every cluster
+	std::vector<unsigned int> partialCounts;
+	std::vector<DataPoint *> spareCentroids; // Previous centroids that are not part of the dataset
+
+	// Mini-batch mode (disabled if the batch size is 0)
+	unsigned int miniBatchSize;
+	unsigned int miniBatchIterations;
+	double miniBatchTolerance; // Mean squared movement of the centroids in an iteration
+	int learningRate;
+	double initialRate;
+	double rateDecay;
+
+	// Warm start
+	std::vector<DataPoint> startCentroids;
+	std::vector<int> startAssignments;
+
+	KMeansClustering(std::vector<DataPoint>&, int, int);
+	KMeansClustering(const KMeansClustering&, std::vector<DataPoint>&);
 
 	void initialize();
-	void assign();
+	void initializeRandom();
+	void initializePlusPlus();
+	void initializeParallel();
+	int sampleIndex(const std::vector<double>&, double);
+	void updateMinDistances(const DataPoint&, std::vector<double>&) const;
+	virtual void assign();
+	// A centroid that was a point of the dataset moved, so the point is back in its cluster
+	virtual void releaseCentroidPoint(unsigned int) {}
+	void buildClusters();
+	int pointIndex(const DataPoint *) const;
 	unsigned int update();
+	int runMiniBatch();
+	void warmStart();
 
-	bool isCentroid(const DataPoint *) const;
-	void resetClusters();
 
-	double silhouetteOfPoint(const DataPoint *) const;
+	double averageSilhouette(const std::vector<DataPoint *>&, const std::vector<unsigned int>&, unsigned int,
+			const std::function<double(const DataPoint *)>&, std::vector<double>&) const;
+	int secondClosestCluster(const DataPoint *, int, double&) const;
+	double silhouetteOfPoint(const DataPoint *, const std::vector<DataPoint *>&, const std::vector<unsigned int>&) const;
 public:
-	KMeansClustering(std::vector<DataPoint>&, int, int);
+	// Default seed of the sampled silhouette (same sample for every run)
+	static const unsigned int SILHOUETTE_SEED = 42;
 
-	int run();
+	static const int RANDOM_INIT = 1;
+	static const int KMEANS_PP_INIT = 2; // k-means++
+	static const int KMEANS_PARALLEL_INIT = 3; // k-means||
+
+	// Learning rate schedules of mini-batch K-means
+	static const int COUNT_LEARNING_RATE = 1; // 1 / (points that moved the centroid so far)
+	static const int DECAYING_LEARNING_RATE = 2; // initial / (1 + decay * iteration)
+
+	KMeansClustering(std::vector<DataPoint>&, int);
+
+	void setInitialization(int method) { initMethod = method; }
+	// Number of threads used (every hardware thread if 0)
+	void setThreads(unsigned int threadsArg) { threads = threadsArg; }
+	// Seed of the initializations and mini-batch K-means (taken from the clock if not set)
+	void setSeed(unsigned int seed) { generator.seed(seed); }
+	// Use mini-batch K-means with the given batch size
+	void setMiniBatch(unsigned int size, unsigned int iterations = 100, double tolerance = 1e-6) {
+		miniBatchSize = size;
+		miniBatchIterations = iterations;
+		miniBatchTolerance = tolerance;
+	}
+	void setLearningRate(int schedule, double initial = 1.0, double decay = 0.0) {
+		learningRate = schedule;
+		initialRate = initial;
+		rateDecay = decay;
+	}
+
+	void setInitialCentroids(const std::vector<DataPoint>&, const std::vector<int>& assignments = std::vector<int>());
+
+	virtual int run();
+	// Approximate bytes used by run() for n points of d dimensions (without the points)
+	static unsigned long estimateMemory(unsigned int, unsigned int, unsigned int, unsigned int);
 	double silhouette(std::vector<double>&) const;
+	double sampledSilhouette(std::vector<double>&, unsigned int, unsigned int seed = SILHOUETTE_SEED) const;
+	double simplifiedSilhouette(std::vector<double>&) const;
 
 	void getNumberOfPointsPerCluster(std::vector<unsigned int>&) const;
 	void getPointsPerCluster(std::vector< std::vector< std::string> >&) const;
 	std::vector<DataPoint *> getCentroids() const { return centroids; }
+	void getAssignments(std::vector<int>&) const;
 	std::vector<DataPoint *> getPointsInSameCluster(const DataPoint&) const;
+	std::vector<DataPoint *> getPointsInSameCluster(unsigned int) const;
+	virtual int nearestCluster(const DataPoint&) const;
+	std::vector<DataPoint *> assignNearest(const DataPoint&) const;
+	bool updatePoints(std::vector<DataPoint>&, const std::vector<unsigned int>&);
+	// Copy of the clusters found by run for a copy of the points (at least as many of them)
+	virtual KMeansClustering *copy(std::vector<DataPoint>& inputPoints) const { return new KMeansClustering(*this, inputPoints); }
 
-	~KMeansClustering() {
+	virtual ~KMeansClustering() {
 		for (unsigned int i = 0; i < centroids.size(); i++) {
 			// Delete centroids that don't match any of the dataset points
 			// (Noted using ID "dummy")
@@ -49,7 +147,113 @@ public:
 				delete centroids[i];
 			}
 		}
+		for (unsigned int i = 0; i < spareCentroids.size(); i++) {
+			delete spareCentroids[i];
+		}
 	}
 };
 
+
+/* Euclidean K-means skipping distance calculations with Hamerly's bounds,
+ * which rely on the triangle inequality */
+class BoundedKMeans: public KMeansClustering {
+private:
+	std::vector<char> boundsValid;
+	std::vector<double> upperBounds; // Upper bound of distance to the assigned centroid
+	std::vector<double> lowerBounds; // Lower bound of distance to every other centroid
+	std::vector<DataPoint> previousCentroids; // Centroids used in the last assignment
+
+	void assign();
+	void releaseCentroidPoint(unsigned int index) {
+		if (index < boundsValid.size()) {
+			boundsValid[index] = false;
+		}
+	}
+
+	BoundedKMeans(const BoundedKMeans& other, std::vector<DataPoint>& inputPoints) : KMeansClustering(other, inputPoints) {}
+public:
+	BoundedKMeans(std::vector<DataPoint>& inputPoints, int numClusters)
+		: KMeansClustering(inputPoints, numClusters, Metrics::EUCLIDEAN) {}
+
+	KMeansClustering *copy(std::vector<DataPoint>& inputPoints) const { return new BoundedKMeans(*this, inputPoints); }
+};
+
+
+/* Spherical K-means (cosine metric): the points and the centroids are unit vectors,
+ * so the closest centroid is the one with the maximum dot product */
+class SphericalKMeans: public KMeansClustering {
+protected:
+	// Points per dot product block
+	static const unsigned int SPHERICAL_BLOCK_SIZE = 128;
+
+	std::vector<double> unitCentroids; // Row-major
+
+	void normalizeCentroids();
+	void assign();
+
+	SphericalKMeans(const SphericalKMeans& other, std::vector<DataPoint>& inputPoints) : KMeansClustering(other, inputPoints) {}
+public:
+	SphericalKMeans(std::vector<DataPoint>& inputPoints, int numClusters)
+		: KMeansClustering(inputPoints, numClusters, Metrics::COSINE) {}
+
+	KMeansClustering *copy(std::vector<DataPoint>& inputPoints) const { return new SphericalKMeans(*this, inputPoints); }
+};
+
+
+/* Spherical K-means finding the closest centroid with an LSH index of the centroids (for many clusters) */
+class LSHSphericalKMeans: public SphericalKMeans {
+private:
+	int lshHashFunctions;
+	int lshTables;
+	LSH *centroidIndex;
+	std::vector<DataPoint> centroidCopies; // Indexed centroids (ID is the cluster index)
+
+	void assign();
+
+	// The index of the centroids is built again by the next assignment
+	LSHSphericalKMeans(const LSHSphericalKMeans& other, std::vector<DataPoint>& inputPoints)
+		: SphericalKMeans(other, inputPoints), lshHashFunctions(other.lshHashFunctions), lshTables(other.lshTables), centroidIndex(NULL) {}
+public:
+	LSHSphericalKMeans(std::vector<DataPoint>& inputPoints, int numClusters, int hashFunctions = 6, int tables = 5)
+		: SphericalKMeans(inputPoints, numClusters), lshHashFunctions(hashFunctions), lshTables(tables), centroidIndex(NULL) {}
+
+	KMeansClustering *copy(std::vector<DataPoint>& inputPoints) const { return new LSHSphericalKMeans(*this, inputPoints); }
+
+	~LSHSphericalKMeans() {
+		delete centroidIndex;
+	}
+};
+
+
+/* Bisecting K-means: split the clusters recursively with 2-means until there are k of them.
+ * The splits form a binary tree whose leaves are the clusters. The initialization, mini-batch
+ * and warm start settings don't apply */
+class BisectingKMeans: public KMeansClustering {
+private:
+	struct TreeNode {
+		DataPoint centroid;
+		int left; // Children (-1 for a leaf)
+		int right;
+		int cluster; // Cluster of a leaf
+	};
+	unsigned int minSplitSize; // Clusters with fewer points are not split
+	std::vector<TreeNode> tree;
+
+	bool split(const std::vector<unsigned int>&, unsigned int, std::vector<unsigned int>&, std::vector<unsigned int>&, DataPoint&, DataPoint&, double&, double&) const;
+
+	BisectingKMeans(const BisectingKMeans& other, std::vector<DataPoint>& inputPoints)
+		: KMeansClustering(other, inputPoints), minSplitSize(other.minSplitSize), tree(other.tree) {}
+public:
+	// Smallest cluster split (2-means needs more than 2 points)
+	static const unsigned int DEFAULT_MIN_SPLIT_SIZE = 4;
+
+	BisectingKMeans(std::vector<DataPoint>& inputPoints, int numClusters, int metric, unsigned int minSize = DEFAULT_MIN_SPLIT_SIZE)
+		: KMeansClustering(inputPoints, numClusters, metric), minSplitSize(minSize) {}
+
+	// Returns the number of rounds of splits
+	int run();
+	int nearestCluster(const DataPoint&) const;
+	KMeansClustering *copy(std::vector<DataPoint>& inputPoints) const { return new BisectingKMeans(*this, inputPoints); }
+};
+
 #endif // CLUSTERING_H
@@ -4,12 +4,19 @@
 #include <set>
 #include <algorithm> // std::sort
 #include <utility> // std::pair, std::make_pair
-#include <cmath> // std::abs
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <exception> // std::exception_ptr
+#include <chrono>
 #include "clustering_recommender.h"
 #include "clustering.h"
 #include "data_point.h"
 #include "metrics.h"
 #include "util.h"
+#include "thread_pool.h"
+#include "prediction.h"
 
 const int ClusteringRecommender::DEFAULT_CLUSTERS = -1;
 
@@ -22,30 +29,132 @@ void ClusteringRecommender::train(std::vector<DataPoint>& userSentiments, const
 		userToSentiment[userSentiments[i].getID()] = i;
 	}
 	clustersAverageSentiment.clear();
-	clusterToSentiment.clear();
+	clusterSentiments.clear();
 	for (unsigned int i = 0; i < clusterSentimentsArg.size(); i++) {
 		clusterSentiments.push_back(clusterSentimentsArg[i]);
 		clustersAverageSentiment.push_back(clustersAvg[i]);
-		clusterToSentiment[clusterSentimentsArg[i].getID()] = i;
 	}
 
+	// Mean-centered ratings used by the predictions
+	userRatings.build(userSentiments, usersAvg);
+	clusterRatings.build(clusterSentiments, clustersAvg);
+
 
 	// Create the clusters for user based and cluster based recommendations
-	if (realUsersClusters != NULL) {
-		delete realUsersClusters;
-	}
 	int newNumClusters = numberOfRealUserClusters;
 	if (numberOfRealUserClusters == DEFAULT_CLUSTERS) {
 		newNumClusters = userSentiments.size() / P;
 	}
-	realUsersClusters = new KMeansClustering(userSentiments, newNumClusters, Metrics::EUCLIDEAN);
-	realUsersClusters->run();
+	realUsersClusters = createClusters(userSentiments, newNumClusters, realUsersClusters, realUsersCentroids);
+
+	// The users are assigned to the closest cluster of virtual users when queried
+	newNumClusters = numberOfVirtualUserClusters;
+	if (numberOfVirtualUserClusters == DEFAULT_CLUSTERS) {
+		newNumClusters = clusterSentiments.size() / P;
+	}
+	virtualUsersClusters = createClusters(clusterSentiments, newNumClusters, virtualUsersClusters, virtualUsersCentroids);
+}
+
+
+
+/* Move the given users to the closest cluster and refresh their ratings after their
+ * sentiments changed. The users after the last trained one are added.
+ * Returns false if the users moved in memory (train again) */
+bool ClusteringRecommender::update(std::vector<DataPoint>& userSentiments, const std::vector<double>& usersAvg, const std::vector<unsigned int>& changed) {
+	if (realUsersClusters == NULL || !userRatings.update(userSentiments, usersAvg, changed)
+			|| !realUsersClusters->updatePoints(userSentiments, changed)) {
+		return false;
+	}
+
+	unsigned int trained = usersAverageSentiment.size();
+	usersAverageSentiment.resize(userSentiments.size());
+	for (unsigned int k = 0; k < changed.size(); k++) {
+		unsigned int i = changed[k];
+		usersAverageSentiment[i] = usersAvg[i];
+		if (i >= trained) {
+			userToSentiment[userSentiments[i].getID()] = i;
+		}
+	}
+	return true;
+}
+
+
+
+ClusteringRecommender *ClusteringRecommender::copy(std::vector<DataPoint>& usersCopy) const {
+	ClusteringRecommender *result = new ClusteringRecommender(numberOfRealUserClusters, numberOfVirtualUserClusters, P);
+	result->initMethod = initMethod;
+	result->boundedAssignment = boundedAssignment;
+	result->bisecting = bisecting;
+	result->realUsersCentroids = realUsersCentroids;
+	result->virtualUsersCentroids = virtualUsersCentroids;
+	result->usersAverageSentiment = usersAverageSentiment;
+	result->clusterSentiments = clusterSentiments;
+	result->clustersAverageSentiment = clustersAverageSentiment;
+	result->userToSentiment = userToSentiment;
+	result->userRatings = userRatings;
+	result->userRatings.moveTo(usersCopy);
+	result->clusterRatings = clusterRatings;
+	result->clusterRatings.moveTo(result->clusterSentiments);
+	if (realUsersClusters != NULL) {
+		result->realUsersClusters = realUsersClusters->copy(usersCopy);
+	}
+	if (virtualUsersClusters != NULL) {
+		result->virtualUsersClusters = virtualUsersClusters->copy(result->clusterSentiments);
+	}
+	return result;
+}
+
+
+
+/* K-means with the selected initialization and assignment */
+KMeansClustering *ClusteringRecommender::newClustering(std::vector<DataPoint>& points, int numClusters) const {
+	KMeansClustering *clustering;
+	if (boundedAssignment) {
+		clustering = new BoundedKMeans(points, numClusters);
+	} else {
+		clustering = new KMeansClustering(points, numClusters);
+	}
+	clustering->setInitialization(initMethod);
+	return clustering;
+}
+
+
+
+/* Run K-means on the given points and delete the previous clustering.
+ * Start from the copies of the previous centroids if only the ratings changed
+ * (e.g. next validation fold) and replace them with the new ones */
+KMeansClustering *ClusteringRecommender::createClusters(std::vector<DataPoint>& points, int numClusters, KMeansClustering *previous,
+		std::vector<DataPoint>& centroidCopies) const {
+	std::vector<int> previousAssignments;
+	if (previous != NULL) {
+		previous->getAssignments(previousAssignments);
+		delete previous;
+	}
+	bool warmStart = (centroidCopies.size() == (unsigned int) numClusters && previousAssignments.size() == points.size());
+
+	KMeansClustering *clustering;
+	if (!warmStart && bisecting) {
+		clustering = new BisectingKMeans(points, numClusters, Metrics::EUCLIDEAN);
+	} else {
+		clustering = newClustering(points, numClusters);
+		if (warmStart) {
+			clustering->setInitialCentroids(centroidCopies, previousAssignments);
+		}
+	}
+	clustering->run();
+
+	std::vector<DataPoint *> centroids = clustering->getCentroids();
+	centroidCopies.clear();
+	for (unsigned int i = 0; i < centroids.size(); i++) {
+		centroidCopies.push_back(*centroids[i]);
+	}
+	return clustering;
 }
 
 
 
 /* Combine user based and cluster based recommendations */
-std::vector<unsigned int> ClusteringRecommender::recommendations(const DataPoint& user, const std::set<unsigned int>& unknown) {
+std::vector<unsigned int> ClusteringRecommender::recommendations(const DataPoint& user, const std::set<unsigned int>& unknown) const {
 	if (userToSentiment.find(user.getID()) == userToSentiment.end() || unknown.size() == 0) {
 		std::vector<unsigned int> empty;
 		return empty;
@@ -85,7 +194,7 @@ std::vector<unsigned int> ClusteringRecommender::userBasedRecommendations(const
 
 /* Return the indices of the recommended coins for a user (top 2)
  * based on total sentiment per user */
-std::vector<unsigned int> ClusteringRecommender::clusterBasedRecommendations(const DataPoint& user, const std::set<unsigned int>& unknown) {
+std::vector<unsigned int> ClusteringRecommender::clusterBasedRecommendations(const DataPoint& user, const std::set<unsigned int>& unknown) const {
 	// Get the predicted ratings of the unrated coins
 	std::vector< std::pair<double, unsigned int> > predictions = clusterBasedPredictions(user, unknown);
 
@@ -108,153 +217,163 @@ std::vector<unsigned int> ClusteringRecommender::clusterBasedRecommendations(con
 /* Return the predicted score for the given unknown coin ratings */
 std::vector< std::pair<double, unsigned int> > ClusteringRecommender::userBasedPredictions(const DataPoint& user, const std::set<unsigned int>& unknown) const {
 	// Get the users in the same cluster as this user
-	unsigned int userIndex = userToSentiment.at(user.getID());
-	std::vector<DataPoint *> neighbors = realUsersClusters->getPointsInSameCluster(user);
+	int userRow = userRatings.row(&user);
+	unsigned int userIndex = (userRow >= 0) ? userRow : userToSentiment.at(user.getID());
+	std::vector<DataPoint *> neighbors = realUsersClusters->getPointsInSameCluster(userIndex);
 
 	std::vector< std::pair<double, unsigned int> > predictions;
 	if (neighbors.size() < 2) { // Nothing in cluster or only user
 		return predictions;
 	}
 
-	// Guess the sentiment of coins without sentiment based on the neighbors
-	for (unsigned int j = 0; j < user.getDimensions(); j++) {
-		if (unknown.find(j) != unknown.end()) {
-			double predictedSentiment = usersAverageSentiment[userIndex];
-
-			// Calculate normalizing factor z and ratings
-			double z_sum = 0.0;
-			double sum = 0.0;
-			for (unsigned int k = 0; k < neighbors.size(); k++) {
-				// Exclude same user
-				if (neighbors[k]->getID() != user.getID()) {
-					z_sum += std::abs(Metrics::euclideanSimilarity(user, *neighbors[k]));
-					unsigned int neighborIndex = userToSentiment.at(neighbors[k]->getID());
-					sum += Metrics::euclideanSimilarity(user, *neighbors[k]) * (neighbors[k]->at(j) - usersAverageSentiment[neighborIndex]);
-				}
-			}
-
-			double z = 1 / z_sum;
-			predictedSentiment += z * sum;
-			predictions.push_back(std::make_pair(predictedSentiment, j));
+	// Row and similarity of every neighbor (computed once for every coin)
+	std::vector<unsigned int> neighborRows;
+	std::vector<double> similarities;
+	for (unsigned int k = 0; k < neighbors.size(); k++) {
+		// Exclude same user
+		int neighborRow = userRatings.row(neighbors[k]);
+		if (neighborRow >= 0 && (unsigned int) neighborRow != userIndex) {
+			neighborRows.push_back(neighborRow);
+			similarities.push_back(Metrics::euclideanSimilarity(user, *neighbors[k]));
 		}
 	}
 
-	return predictions;
+	// Guess the sentiment of coins without sentiment based on the neighbors
+	return userRatings.predict(userRatings.average(userIndex), neighborRows, similarities, unknown);
 }
 
 
 
 /* Return the predicted score for the given unknown coin ratings */
-std::vector< std::pair<double, unsigned int> > ClusteringRecommender::clusterBasedPredictions(const DataPoint& user, const std::set<unsigned int>& unknown) {
-	// Perform the clustering of this user with all the virtual users
-	int newNumClusters = numberOfVirtualUserClusters;
-	if (numberOfVirtualUserClusters == DEFAULT_CLUSTERS) {
-		newNumClusters = clusterSentiments.size() / P;
-	}
-	// Add the user to the virtual users
-	clusterSentiments.push_back(user);
-	virtualUsersClusters = new KMeansClustering(clusterSentiments, newNumClusters, Metrics::EUCLIDEAN);
-	virtualUsersClusters->run();
-
-
-	// Get the virtual users in the same cluster as this user
-	unsigned int userIndex = userToSentiment.at(user.getID());
-	std::vector<DataPoint *> neighbors = virtualUsersClusters->getPointsInSameCluster(user);
+std::vector< std::pair<double, unsigned int> > ClusteringRecommender::clusterBasedPredictions(const DataPoint& user, const std::set<unsigned int>& unknown) const {
+	// Get the virtual users in the cluster closest to this user
+	int userRow = userRatings.row(&user);
+	unsigned int userIndex = (userRow >= 0) ? userRow : userToSentiment.at(user.getID());
+	std::vector<DataPoint *> neighbors = virtualUsersClusters->assignNearest(user);
 
 	std::vector< std::pair<double, unsigned int> > predictions;
-	if (neighbors.size() < 2) { // Nothing in cluster or only user
-		// Remove user from virtual users again
-		clusterSentiments.pop_back();
-		delete virtualUsersClusters;
-		virtualUsersClusters = NULL;
+	if (neighbors.size() == 0) { // Nothing in cluster
 		return predictions;
 	}
 
-	// Guess the sentiment of coins without sentiment based on the neighbors
-	for (unsigned int j = 0; j < user.getDimensions(); j++) {
-		if (unknown.find(j) != unknown.end()) {
-			double predictedSentiment = usersAverageSentiment[userIndex];
-
-			// Calculate normalizing factor z and ratings
-			double z_sum = 0.0;
-			double sum = 0.0;
-			for (unsigned int k = 0; k < neighbors.size(); k++) {
-				// Exclude the user
-				if (neighbors[k]->getID() != user.getID()) {
-					z_sum += std::abs(Metrics::euclideanSimilarity(user, *neighbors[k]));
-					unsigned int neighborIndex = clusterToSentiment.at(neighbors[k]->getID());
-					sum += Metrics::euclideanSimilarity(user, *neighbors[k]) * (neighbors[k]->at(j) - clustersAverageSentiment[neighborIndex]);
-				}
-			}
-
-			double z = 1 / z_sum;
-			predictedSentiment += z * sum;
-			predictions.push_back(std::make_pair(predictedSentiment, j));
+	// Row and similarity of every neighbor (computed once for every coin)
+	std::vector<unsigned int> neighborRows;
+	std::vector<double> similarities;
+	for (unsigned int k = 0; k < neighbors.size(); k++) {
+		// The virtual users are rows of the cluster matrix (never the user)
+		int neighborRow = clusterRatings.row(neighbors[k]);
+		if (neighborRow >= 0) {
+			neighborRows.push_back(neighborRow);
+			similarities.push_back(Metrics::euclideanSimilarity(user, *neighbors[k]));
 		}
 	}
 
-	// Remove user from virtual users again
-	clusterSentiments.pop_back();
-
-	delete virtualUsersClusters;
-	virtualUsersClusters = NULL;
-
-	return predictions;
+	// Guess the sentiment of coins without sentiment based on the neighbors
+	return clusterRatings.predict(userRatings.average(userIndex), neighborRows, similarities, unknown);
 }
 
 
 
-/* Find the number of clusters from the options with the best silhouette evaluation */
-std::vector<int> ClusteringRecommender::findBestClusters(const std::vector<int>& options, std::vector<DataPoint>& userSentiments, std::vector<DataPoint>& clusterSentiments) const {
-	// Find best for real users
-	double max = 0.0;
-	int maxClusters = 0;
-	for (auto num : options) {
-		if (num == DEFAULT_CLUSTERS) {
-			num = usersAverageSentiment.size() / P;
-		}
+/* Find the number of clusters from the options with the best silhouette evaluation.
+ * Every (dataset, number of clusters) configuration is a task of a pool with the given
+ * number of workers. A task waits to start while the estimated memory of the running
+ * tasks would exceed the budget (unless nothing else runs) */
+std::vector<int> ClusteringRecommender::findBestClusters(const std::vector<int>& options, std::vector<DataPoint>& userSentiments, std::vector<DataPoint>& clusterSentiments,
+		unsigned int silhouetteSample, unsigned int workers, unsigned long memoryBudget) const {
+	// Create the configurations: real users first, then virtual users
+	std::vector<std::vector<DataPoint> *> datasets;
+	datasets.push_back(&userSentiments);
+	datasets.push_back(&clusterSentiments);
 
-		if ((unsigned int) num <= usersAverageSentiment.size() && num > 1) {
-			KMeansClustering *clustering = new KMeansClustering(userSentiments, num, Metrics::EUCLIDEAN);
-			clustering->run();
-			
-			std::vector<double> temp;
-			double silhouette = clustering->silhouette(temp);
-			std::cout << "Silhouette for " << num << " is: " << silhouette << std::endl;
-			if (silhouette > max) {
-				max = silhouette;
-				maxClusters = num;
+	std::vector<SweepConfiguration> configurations;
+	for (unsigned int d = 0; d < datasets.size(); d++) {
+		unsigned int size = (d == 0) ? usersAverageSentiment.size() : clustersAverageSentiment.size();
+		for (auto num : options) {
+			if (num == DEFAULT_CLUSTERS) {
+				num = size / P;
 			}
 
-			delete clustering;
+			if ((unsigned int) num < size && num > 1) {
+				SweepConfiguration configuration;
+				configuration.dataset = d;
+				configuration.clusters = num;
+				configurations.push_back(configuration);
+			}
 		}
 	}
-	std::vector<int> result;
-	result.push_back(maxClusters);
-
-	// Find best for virtual users
-	max = 0.0;
-	maxClusters = 0;
-	for (auto num : options) {
-		if ((unsigned int) num <= clustersAverageSentiment.size() && num > 1) {
-			if (num == DEFAULT_CLUSTERS) {
-				num = clustersAverageSentiment.size() / P;
+
+
+	ThreadPool sweepPool(workers);
+	// Share the hardware threads between the clusterings running at the same time
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	unsigned int threadsPerClustering = (hardwareThreads > sweepPool.size()) ? hardwareThreads / sweepPool.size() : 1;
+
+	std::mutex memoryMutex;
+	std::condition_variable memoryFreed;
+	unsigned long memoryUsed = 0;
+
+	std::vector< std::future<void> > finished;
+	for (unsigned int c = 0; c < configurations.size(); c++) {
+		finished.push_back(sweepPool.submit([&, c]() {
+			SweepConfiguration& configuration = configurations[c];
+			std::vector<DataPoint>& points = *datasets[configuration.dataset];
+			unsigned long memory = KMeansClustering::estimateMemory(points.size(), points[0].getDimensions(), configuration.clusters, threadsPerClustering)
+					+ sizeof(DataPoint *) * silhouetteSample;
+			{
+				std::unique_lock<std::mutex> lock(memoryMutex);
+				memoryFreed.wait(lock, [&]() { return memoryUsed == 0 || memoryUsed + memory <= memoryBudget; });
+				memoryUsed += memory;
 			}
 
-			KMeansClustering *clustering = new KMeansClustering(clusterSentiments, num, Metrics::EUCLIDEAN);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			KMeansClustering *clustering = newClustering(points, configuration.clusters);
+			clustering->setThreads(threadsPerClustering);
 			clustering->run();
-			
+
 			std::vector<double> temp;
-			double silhouette = clustering->silhouette(temp);
-			std::cout << "Silhouette for " << num << " is: " << silhouette << std::endl;;
-			if (silhouette > max) {
-				max = silhouette;
-				maxClusters = num;
+			if (silhouetteSample == 0) {
+				configuration.silhouette = clustering->silhouette(temp);
+			} else { // Exact silhouette is quadratic: use a sample for many points
+				configuration.silhouette = clustering->sampledSilhouette(temp, silhouetteSample);
 			}
-
 			delete clustering;
+			configuration.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			{
+				std::unique_lock<std::mutex> lock(memoryMutex);
+				memoryUsed -= memory;
+			}
+			memoryFreed.notify_all();
+		}));
+	}
+	// The tasks use the locals of this function: wait for all of them before rethrowing
+	std::exception_ptr error;
+	for (unsigned int c = 0; c < finished.size(); c++) {
+		try {
+			finished[c].get();
+		} catch (...) {
+			if (!error) {
+				error = std::current_exception();
+			}
 		}
 	}
-	result.push_back(maxClusters);
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+
+	// Find best for real users and virtual users (in the order of the options)
+	std::vector<int> result(datasets.size(), 0);
+	std::vector<double> max(datasets.size(), 0.0);
+	for (unsigned int c = 0; c < configurations.size(); c++) {
+		const SweepConfiguration& configuration = configurations[c];
+		std::cout << "Silhouette for " << configuration.clusters << " is: " << configuration.silhouette
+			<< " (" << configuration.seconds << " seconds)" << std::endl;
+		if (configuration.silhouette > max[configuration.dataset]) {
+			max[configuration.dataset] = configuration.silhouette;
+			result[configuration.dataset] = configuration.clusters;
+		}
+	}
+
 	return result;
 }
@@ -8,36 +8,70 @@
 #include <utility> // std::pair
 #include "clustering.h"
 #include "data_point.h"
+#include "prediction.h"
 
 class ClusteringRecommender {
 private:
+	// A number of clusters tried by findBestClusters
+	struct SweepConfiguration {
+		unsigned int dataset; // 0 for real users, 1 for virtual users
+		int clusters;
+		double silhouette;
+		double seconds;
+	};
+
 	int numberOfRealUserClusters;
 	int numberOfVirtualUserClusters;
 	unsigned int P;
+	int initMethod; // Initialization of K-means (KMeansClustering constants)
+	bool boundedAssignment; // Skip distance calculations with Hamerly's bounds
+	bool bisecting; // Cluster with bisecting K-means when there is no warm start
 
 	KMeansClustering *realUsersClusters;
 	KMeansClustering *virtualUsersClusters;
+	// Copies of the centroids of the clusterings (a centroid may be a point of the data,
+	// which changes before the next training starts from them)
+	std::vector<DataPoint> realUsersCentroids;
+	std::vector<DataPoint> virtualUsersCentroids;
 
 	std::vector<double> usersAverageSentiment;
 	std::vector<DataPoint> clusterSentiments;
 	std::vector<double> clustersAverageSentiment;
 
 	std::unordered_map<std::string, unsigned int> userToSentiment;
-	std::unordered_map<std::string, unsigned int> clusterToSentiment;
+
+	// Mean-centered ratings of the users and the virtual users (rebuilt by train)
+	RatingMatrix userRatings;
+	RatingMatrix clusterRatings;
 
 	std::vector<unsigned int> userBasedRecommendations(const DataPoint&, const std::set<unsigned int>&) const;
-	std::vector<unsigned int> clusterBasedRecommendations(const DataPoint&, const std::set<unsigned int>&);
+	std::vector<unsigned int> clusterBasedRecommendations(const DataPoint&, const std::set<unsigned int>&) const;
+	KMeansClustering *newClustering(std::vector<DataPoint>&, int) const;
+	KMeansClustering *createClusters(std::vector<DataPoint>&, int, KMeansClustering *, std::vector<DataPoint>&) const;
 public:
 	static const int DEFAULT_CLUSTERS;
 
 	ClusteringRecommender(int userClusters, int virtualClusters, unsigned int PArg)
-		: numberOfRealUserClusters(userClusters), numberOfVirtualUserClusters(virtualClusters), P(PArg), realUsersClusters(NULL), virtualUsersClusters(NULL) {}
+		: numberOfRealUserClusters(userClusters), numberOfVirtualUserClusters(virtualClusters), P(PArg),
+		  initMethod(KMeansClustering::RANDOM_INIT), boundedAssignment(false), bisecting(false), realUsersClusters(NULL), virtualUsersClusters(NULL) {}
 
-	std::vector<unsigned int> recommendations(const DataPoint&, const std::set<unsigned int>&);
+	void setInitialization(int method) { initMethod = method; }
+	void setBoundedAssignment(bool enable) { boundedAssignment = enable; }
+	void setBisecting(bool enable) { bisecting = enable; }
+
+	std::vector<unsigned int> recommendations(const DataPoint&, const std::set<unsigned int>&) const;
 	void train(std::vector<DataPoint>&, const std::vector<double>&, std::vector<DataPoint>&, const std::vector<double>&);
+	bool update(std::vector<DataPoint>&, const std::vector<double>&, const std::vector<unsigned int>&);
+	// Copy of the trained recommender for a copy of the users it was trained on
+	ClusteringRecommender *copy(std::vector<DataPoint>&) const;
 	std::vector< std::pair<double, unsigned int> > userBasedPredictions(const DataPoint&, const std::set<unsigned int>&) const;
-	std::vector< std::pair<double, unsigned int> > clusterBasedPredictions(const DataPoint&, const std::set<unsigned int>&);
-	std::vector<int> findBestClusters(const std::vector<int>&, std::vector<DataPoint>&, std::vector<DataPoint>&) const;
+	std::vector< std::pair<double, unsigned int> > clusterBasedPredictions(const DataPoint&, const std::set<unsigned int>&) const;
+	static const unsigned long DEFAULT_SWEEP_MEMORY = 1UL << 30; // 1 GB
+
+	// Evaluate with the exact silhouette if silhouetteSample is 0, else with a sample of that many points.
+	// Use every hardware thread as a worker if workers is 0
+	std::vector<int> findBestClusters(const std::vector<int>&, std::vector<DataPoint>&, std::vector<DataPoint>&,
+			unsigned int silhouetteSample = 0, unsigned int workers = 0, unsigned long memoryBudget = DEFAULT_SWEEP_MEMORY) const;
 
 	~ClusteringRecommender() {
 		if (realUsersClusters != NULL) {
@@ -1,14 +1,18 @@
+#include <iostream>
 #include <vector>
 #include <string>
 #include <set>
 #include <algorithm> // std::sort
 #include <utility> // std::pair, std::make_pair
-#include <cmath> // std::abs
 #include "cosine_lsh_recommender.h"
+#include "neighbor_search.h"
+#include "exact_search.h"
+#include "hnsw.h"
 #include "LSH/LSH.h"
 #include "data_point.h"
 #include "metrics.h"
 #include "util.h"
+#include "prediction.h"
 
 void CosineLSHRecommender::train(std::vector<DataPoint>& userSentiments, const std::vector<double>& usersAvg, std::vector<DataPoint>& clusterSentiments, const std::vector<double>& clustersAvg) {
 	// Save the averages
@@ -18,30 +22,105 @@ void CosineLSHRecommender::train(std::vector<DataPoint>& userSentiments, const s
 		usersAverageSentiment.push_back(usersAvg[i]);
 		userToSentiment[userSentiments[i].getID()] = i;
 	}
-	clustersAverageSentiment.clear();
-	clusterToSentiment.clear();
-	for (unsigned int i = 0; i < clusterSentiments.size(); i++) {
-		clustersAverageSentiment.push_back(clustersAvg[i]);
-		clusterToSentiment[clusterSentiments[i].getID()] = i;
+
+	// Mean-centered ratings used by the predictions
+	userRatings.build(userSentiments, usersAvg);
+	clusterRatings.build(clusterSentiments, clustersAvg);
+
+
+	// Insert every user vector in the Cosine LSH (or the selected index) for user based and cluster based recommendations
+	if (userSearch != NULL) {
+		delete userSearch;
 	}
+	userSearch = buildSearch(userSentiments, "users");
+
+	if (clusterSearch != NULL) {
+		delete clusterSearch;
+	}
+	clusterSearch = buildSearch(clusterSentiments, "clusters");
+}
+
 
 
-	// Insert every user vector in the Cosine LSH for user based and cluster based recommendations
-	if (userLSH != NULL) {
-		delete userLSH;
+/* Refresh the index entries and the ratings of the given users after their sentiments
+ * changed. The users after the last trained one are inserted.
+ * Returns false if the users moved in memory (train again) */
+bool CosineLSHRecommender::update(std::vector<DataPoint>& userSentiments, const std::vector<double>& usersAvg, const std::vector<unsigned int>& changed) {
+	unsigned int trained = usersAverageSentiment.size();
+	if (userSearch == NULL || !userRatings.update(userSentiments, usersAvg, changed)) {
+		return false;
 	}
-	userLSH = new LSH(kLSH, userSentiments[0].getDimensions(), L, userSentiments.size());
-	for (unsigned int i = 0; i < userSentiments.size(); i++) {
-		userLSH->insert(userSentiments[i]);
+
+	usersAverageSentiment.resize(userSentiments.size());
+	for (unsigned int k = 0; k < changed.size(); k++) {
+		unsigned int i = changed[k];
+		usersAverageSentiment[i] = usersAvg[i];
+		if (i < trained) {
+			userSearch->update(userSentiments[i]);
+		} else {
+			userSearch->insert(userSentiments[i]);
+			userToSentiment[userSentiments[i].getID()] = i;
+		}
+	}
+	return true;
+}
+
+
+
+CosineLSHRecommender *CosineLSHRecommender::copy(const std::vector<DataPoint>& users, std::vector<DataPoint>& usersCopy,
+		const std::vector<DataPoint>& clusters, std::vector<DataPoint>& clustersCopy) const {
+	CosineLSHRecommender *result = new CosineLSHRecommender(numberOfNeighbors, kLSH, L, searchMethod);
+	result->setSignatureFilter(signatureBits, rerankSize);
+	result->setStructuredProjections(structuredProjections);
+	result->setHNSWParameters(hnswM, hnswEfConstruction, hnswEfSearch);
+	result->setGraphPrefix(graphPrefix);
+	result->usersAverageSentiment = usersAverageSentiment;
+	result->userToSentiment = userToSentiment;
+	result->userRatings = userRatings;
+	result->userRatings.moveTo(usersCopy);
+	result->clusterRatings = clusterRatings;
+	result->clusterRatings.moveTo(clustersCopy);
+	if (userSearch != NULL) {
+		result->userSearch = userSearch->copy(users, usersCopy);
 	}
+	if (clusterSearch != NULL) {
+		result->clusterSearch = clusterSearch->copy(clusters, clustersCopy);
+	}
+	return result;
+}
 
-	if (clusterLSH != NULL) {
-		delete clusterLSH;
+
+
+/* Create an empty index of the selected search method */
+NeighborSearch *CosineLSHRecommender::createSearch(unsigned int dimensions, unsigned int n) const {
+	if (searchMethod == NeighborSearch::EXACT_SEARCH) {
+		return new ExactSearch(dimensions);
+	} else if (searchMethod == NeighborSearch::HNSW_SEARCH) {
+		return new HNSW(dimensions, hnswM, hnswEfConstruction, hnswEfSearch);
 	}
-	clusterLSH = new LSH(kLSH, clusterSentiments[0].getDimensions(), L, clusterSentiments.size());
-	for (unsigned int i = 0; i < clusterSentiments.size(); i++) {
-		clusterLSH->insert(clusterSentiments[i]);
+	return new LSH(kLSH, dimensions, L, n, signatureBits, rerankSize, structuredProjections);
+}
+
+
+
+/* Create the index of the given points. A saved HNSW graph of the same
+ * points is loaded instead of building it again */
+NeighborSearch *CosineLSHRecommender::buildSearch(std::vector<DataPoint>& points, const std::string& name) const {
+	NeighborSearch *search = createSearch(points[0].getDimensions(), points.size());
+	if (searchMethod != NeighborSearch::HNSW_SEARCH || graphPrefix == "") {
+		search->insertAll(points);
+		return search;
+	}
+
+	HNSW *graph = static_cast<HNSW *>(search);
+	std::string filename = graphPrefix + "." + name + ".hnsw";
+	if (!graph->load(filename.c_str(), points)) {
+		graph->insertAll(points);
+		if (!graph->save(filename.c_str())) {
+			std::cerr << "[-] Couldn't save the HNSW graph: " << filename << std::endl;
+		}
 	}
+	return search;
 }
 
 
@@ -63,24 +142,63 @@ std::vector<unsigned int> CosineLSHRecommender::recommendations(const DataPoint&
 
 
 
+/* Combine user based and cluster based recommendations for a batch of users.
+ * The neighbors of all the users are found with one batched query on each index */
+std::vector< std::vector<unsigned int> > CosineLSHRecommender::recommendations(const std::vector<const DataPoint *>& users, const std::vector<const std::set<unsigned int> *>& unknown) const {
+	std::vector< std::vector<unsigned int> > results(users.size());
+
+	// Keep only the users that can get recommendations
+	std::vector<const DataPoint *> queries;
+	std::vector<unsigned int> queryIndices;
+	for (unsigned int i = 0; i < users.size(); i++) {
+		if (userToSentiment.find(users[i]->getID()) != userToSentiment.end() && unknown[i]->size() > 0) {
+			queries.push_back(users[i]);
+			queryIndices.push_back(i);
+		}
+	}
+	// Not trained or no user to query
+	if (userSearch == NULL || clusterSearch == NULL || queries.empty()) {
+		return results;
+	}
+
+	// One more user neighbor is needed since the user himself is excluded
+	std::vector< std::vector<DataPoint *> > userNeighbors;
+	std::vector< std::vector<double> > userDistances;
+	userSearch->findNearestNeighborsBatch(queries, numberOfNeighbors + 1, userNeighbors, userDistances);
+
+	std::vector< std::vector<DataPoint *> > clusterNeighbors;
+	std::vector< std::vector<double> > clusterDistances;
+	clusterSearch->findNearestNeighborsBatch(queries, numberOfNeighbors, clusterNeighbors, clusterDistances);
+
+	for (unsigned int q = 0; q < queries.size(); q++) {
+		const DataPoint& user = *queries[q];
+		const std::set<unsigned int>& userUnknown = *unknown[queryIndices[q]];
+
+		std::vector< std::pair<double, unsigned int> > predictions = predict(user, userNeighbors[q], userDistances[q], true, userRatings, userUnknown);
+		std::vector<unsigned int> result = bestCoins(predictions, 5);
+
+		predictions = predict(user, clusterNeighbors[q], clusterDistances[q], false, clusterRatings, userUnknown);
+		std::vector<unsigned int> result2 = bestCoins(predictions, 2);
+		for (unsigned int i = 0; i < result2.size(); i++) {
+			result.push_back(result2[i]);
+		}
+
+		results[queryIndices[q]] = result;
+	}
+
+	return results;
+}
+
+
+
 /* Return the indices of the recommended coins for a user (top 5)
  * based on total sentiment per user */
 std::vector<unsigned int> CosineLSHRecommender::userBasedRecommendations(const DataPoint& user, const std::set<unsigned int>& unknown) const {
 	// Get the predicted ratings of the unrated coins
 	std::vector< std::pair<double, unsigned int> > predictions = userBasedPredictions(user, unknown);
 
-	// Sort in descending order using lambda
-	std::sort(predictions.begin(), predictions.end(), [](const std::pair<double, unsigned int>& left, const std::pair<double, unsigned int>& right) {
-		return left.first > right.first;
-	});
-
 	// Get the top 5 coins based on sentiment
-	std::vector<unsigned int> recommendedCoins;
-	for (unsigned int j = 0; j < min(5, predictions.size()); j++) {
-		recommendedCoins.push_back(predictions[j].second);
-	}
-
-	return recommendedCoins;
+	return bestCoins(predictions, 5);
 }
 
 
@@ -91,14 +209,21 @@ std::vector<unsigned int> CosineLSHRecommender::clusterBasedRecommendations(cons
 	// Get the predicted ratings of the unrated coins
 	std::vector< std::pair<double, unsigned int> > predictions = clusterBasedPredictions(user, unknown);
 
+	// Get the top 2 coins based on sentiment
+	return bestCoins(predictions, 2);
+}
+
+
+
+/* Return the indices of the coins with the highest predicted ratings */
+std::vector<unsigned int> CosineLSHRecommender::bestCoins(std::vector< std::pair<double, unsigned int> >& predictions, unsigned int count) const {
 	// Sort in descending order using lambda
 	std::sort(predictions.begin(), predictions.end(), [](const std::pair<double, unsigned int>& left, const std::pair<double, unsigned int>& right) {
 		return left.first > right.first;
 	});
 
-	// Get the top 2 coins based on sentiment
 	std::vector<unsigned int> recommendedCoins;
-	for (unsigned int j = 0; j < min(2, predictions.size()); j++) {
+	for (unsigned int j = 0; j < min(count, predictions.size()); j++) {
 		recommendedCoins.push_back(predictions[j].second);
 	}
 
@@ -109,64 +234,12 @@ std::vector<unsigned int> CosineLSHRecommender::clusterBasedRecommendations(cons
 
 /* Return the predicted score for the given unknown coin ratings */
 std::vector< std::pair<double, unsigned int> > CosineLSHRecommender::userBasedPredictions(const DataPoint& user, const std::set<unsigned int>& unknown) const {
-	// Get the P neighbors from the LSH
-	unsigned int userIndex = userToSentiment.at(user.getID());
+	// Get the P neighbors from the LSH (one more since the user himself is excluded)
 	std::vector<DataPoint *> neighbors;
 	std::vector<double> distances;
-	userLSH->findAllNeighbors(user, neighbors, distances);
-
-	std::vector< std::pair<double, unsigned int> > predictions;
-
-	// Sort the neighbors by distance and keep the top P neighbors excluding the user himself
-	std::vector< std::pair<double, unsigned int> > distancesAndIndices;
-	// Create the vector of distances and indices used to find the indices of the closest neighbors
-	for (unsigned int j = 0; j < distances.size(); j++) {
-		// Exclude the same user
-		if (neighbors[j]->getID() != user.getID()) {
-			distancesAndIndices.push_back(std::make_pair(distances[j], j));
-		}
-	}
+	userSearch->findNearestNeighbors(user, numberOfNeighbors + 1, neighbors, distances);
 
-	// No neighbors or only same user
-	if (distancesAndIndices.size() == 0) {
-		return predictions; // Empty
-	}
-
-	std::sort(distancesAndIndices.begin(), distancesAndIndices.end());
-
-	// Get the P nearest neighbors
-	std::vector<DataPoint *> closest;
-	for (unsigned int j = 0; j < min(numberOfNeighbors, distancesAndIndices.size()); j++) {
-		closest.push_back(neighbors[distancesAndIndices[j].second]);
-	}
-
-
-	// Guess the sentiment of coins without sentiment based on the neighbors
-	for (unsigned int j = 0; j < user.getDimensions(); j++) {
-		if (unknown.find(j) != unknown.end()) {
-			double predictedSentiment = usersAverageSentiment[userIndex];
-
-			// Calculate normalizing factor z and ratings
-			double z_sum = 0.0;
-			double sum = 0.0;
-			for (unsigned int k = 0; k < closest.size(); k++) {
-				z_sum += std::abs(Metrics::cosineSimilarity(user, *closest[k]));
-				unsigned int neighborIndex = userToSentiment.at(closest[k]->getID());
-				sum += Metrics::cosineSimilarity(user, *closest[k]) * (closest[k]->at(j) - usersAverageSentiment[neighborIndex]);
-			}
-
-			double z;
-			if (z_sum != 0) { // Similarity with every point is 0
-				z = 1 / z_sum;
-			} else {
-				z = 1;
-			}
-			predictedSentiment += z * sum;
-			predictions.push_back(std::make_pair(predictedSentiment, j));
-		}
-	}
-
-	return predictions;
+	return predict(user, neighbors, distances, true, userRatings, unknown);
 }
 
 
@@ -174,56 +247,56 @@ std::vector< std::pair<double, unsigned int> > CosineLSHRecommender::userBasedPr
 /* Return the predicted score for the given unknown coin ratings */
 std::vector< std::pair<double, unsigned int> > CosineLSHRecommender::clusterBasedPredictions(const DataPoint& user, const std::set<unsigned int>& unknown) const {
 	// Get the P neighbors from the LSH
-	unsigned int userIndex = userToSentiment.at(user.getID());
 	std::vector<DataPoint *> neighbors;
 	std::vector<double> distances;
-	clusterLSH->findAllNeighbors(user, neighbors, distances);
+	clusterSearch->findNearestNeighbors(user, numberOfNeighbors, neighbors, distances);
 
+	return predict(user, neighbors, distances, false, clusterRatings, unknown);
+}
+
+
+
+/* Predict the unknown coin ratings of a user from the neighbors found in the index
+ * (The user himself is excluded from the neighbors if excludeUser is set).
+ * The neighbors are rows of the given rating matrix (found by their address) */
+std::vector< std::pair<double, unsigned int> > CosineLSHRecommender::predict(const DataPoint& user, const std::vector<DataPoint *>& neighbors, const std::vector<double>& distances, bool excludeUser,
+		const RatingMatrix& neighborRatings, const std::set<unsigned int>& unknown) const {
+	// The user is compared by row if he is one of the indexed users, otherwise by ID
+	int userRow = userRatings.row(&user);
+	double userAverage = (userRow >= 0) ? userRatings.average(userRow) : usersAverageSentiment[userToSentiment.at(user.getID())];
 	std::vector< std::pair<double, unsigned int> > predictions;
-	if (neighbors.size() == 0) {
-		return predictions;
-	}
 
 	// Sort the neighbors by distance and keep the top P neighbors
 	std::vector< std::pair<double, unsigned int> > distancesAndIndices;
 	// Create the vector of distances and indices used to find the indices of the closest neighbors
 	for (unsigned int j = 0; j < distances.size(); j++) {
-		distancesAndIndices.push_back(std::make_pair(distances[j], j));
+		// Exclude the same user
+		bool sameUser = excludeUser && ((userRow >= 0) ? neighborRatings.row(neighbors[j]) == userRow : neighbors[j]->getID() == user.getID());
+		if (!sameUser) {
+			distancesAndIndices.push_back(std::make_pair(distances[j], j));
+		}
 	}
 
-	std::sort(distancesAndIndices.begin(), distancesAndIndices.end());
-
-	// Get the P nearest neighbors
-	std::vector<DataPoint *> closest;
-	for (unsigned int j = 0; j < min(numberOfNeighbors, distancesAndIndices.size()); j++) {
-		closest.push_back(neighbors[distancesAndIndices[j].second]);
+	// No neighbors or only same user
+	if (distancesAndIndices.size() == 0) {
+		return predictions; // Empty
 	}
 
+	std::sort(distancesAndIndices.begin(), distancesAndIndices.end());
 
-	// Guess the sentiment of coins without sentiment based on the neighbors
-	for (unsigned int j = 0; j < user.getDimensions(); j++) {
-		if (unknown.find(j) != unknown.end()) {
-			double predictedSentiment = usersAverageSentiment[userIndex];
-
-			// Calculate normalizing factor z and ratings
-			double z_sum = 0.0;
-			double sum = 0.0;
-			for (unsigned int k = 0; k < closest.size(); k++) {
-				z_sum += std::abs(Metrics::cosineSimilarity(user, *closest[k]));
-				unsigned int neighborIndex = clusterToSentiment.at(closest[k]->getID());
-				sum += Metrics::cosineSimilarity(user, *closest[k]) * (closest[k]->at(j) - clustersAverageSentiment[neighborIndex]);
-			}
-
-			double z;
-			if (z_sum != 0) {
-				z = 1 / z_sum;
-			} else {
-				z = 1;
-			}
-			predictedSentiment += z * sum;
-			predictions.push_back(std::make_pair(predictedSentiment, j));
+	// Get the rows of the P nearest neighbors with their similarities (computed once for every coin)
+	std::vector<unsigned int> closestRows;
+	std::vector<double> similarities;
+	for (unsigned int j = 0; j < min(numberOfNeighbors, distancesAndIndices.size()); j++) {
+		const DataPoint *neighbor = neighbors[distancesAndIndices[j].second];
+		int neighborRow = neighborRatings.row(neighbor);
+		if (neighborRow < 0) { // Not a point of the index
+			continue;
 		}
+		closestRows.push_back(neighborRow);
+		similarities.push_back(Metrics::cosineSimilarity(user, *neighbor));
 	}
 
-	return predictions;
+	// Guess the sentiment of coins without sentiment based on the neighbors
+	return neighborRatings.predict(userAverage, closestRows, similarities, unknown);
 }
@@ -6,40 +6,69 @@
 #include <unordered_map>
 #include <set>
 #include <utility> // std::pair
-#include "LSH/LSH.h"
+#include "neighbor_search.h"
 #include "data_point.h"
+#include "prediction.h"
 
 class CosineLSHRecommender {
 private:
 	unsigned int numberOfNeighbors;
-	LSH *userLSH;
-	LSH *clusterLSH;
+	NeighborSearch *userSearch;
+	NeighborSearch *clusterSearch;
 	int kLSH;
 	int L;
+	// Signature bits and candidates kept by the Hamming distance filter of the LSH (disabled if 0)
+	unsigned int signatureBits;
+	unsigned int rerankSize;
+	bool structuredProjections; // Hash with Hadamard transforms instead of r_i vectors
+	int searchMethod; // Index used to find the neighbors (NeighborSearch::LSH_SEARCH, EXACT_SEARCH or HNSW_SEARCH)
 
-	std::vector<double> usersAverageSentiment;
-	std::vector<double> clustersAverageSentiment;
+	// HNSW parameters
+	unsigned int hnswM;
+	unsigned int hnswEfConstruction;
+	unsigned int hnswEfSearch;
+	// Prefix of the files used to save and load the HNSW graphs (not saved if empty)
+	std::string graphPrefix;
 
+	std::vector<double> usersAverageSentiment;
 	std::unordered_map<std::string, unsigned int> userToSentiment;
-	std::unordered_map<std::string, unsigned int> clusterToSentiment;
 
+	// Mean-centered ratings of the indexed users and clusters (rebuilt by train)
+	RatingMatrix userRatings;
+	RatingMatrix clusterRatings;
+
+	NeighborSearch *createSearch(unsigned int, unsigned int) const;
+	NeighborSearch *buildSearch(std::vector<DataPoint>&, const std::string&) const;
 	std::vector<unsigned int> userBasedRecommendations(const DataPoint&, const std::set<unsigned int>&) const;
 	std::vector<unsigned int> clusterBasedRecommendations(const DataPoint&, const std::set<unsigned int>&) const;
+	std::vector<unsigned int> bestCoins(std::vector< std::pair<double, unsigned int> >&, unsigned int) const;
+	std::vector< std::pair<double, unsigned int> > predict(const DataPoint&, const std::vector<DataPoint *>&, const std::vector<double>&, bool,
+		const RatingMatrix&, const std::set<unsigned int>&) const;
 public:
-	CosineLSHRecommender(unsigned int neighborsArg, int kLSHArg = 4, int LArg = 5)
-		: numberOfNeighbors(neighborsArg), userLSH(NULL), clusterLSH(NULL), kLSH(kLSHArg), L(LArg) {}
+	CosineLSHRecommender(unsigned int neighborsArg, int kLSHArg = 4, int LArg = 5, int searchArg = NeighborSearch::LSH_SEARCH)
+		: numberOfNeighbors(neighborsArg), userSearch(NULL), clusterSearch(NULL), kLSH(kLSHArg), L(LArg), signatureBits(0), rerankSize(0), structuredProjections(false), searchMethod(searchArg),
+		hnswM(16), hnswEfConstruction(200), hnswEfSearch(50) {}
+
+	void setHNSWParameters(unsigned int M, unsigned int efConstruction, unsigned int efSearch) { hnswM = M; hnswEfConstruction = efConstruction; hnswEfSearch = efSearch; }
+	void setSignatureFilter(unsigned int bits, unsigned int rerank) { signatureBits = bits; rerankSize = rerank; }
+	void setStructuredProjections(bool structured) { structuredProjections = structured; }
+	void setGraphPrefix(const std::string& prefix) { graphPrefix = prefix; }
 
 	void train(std::vector<DataPoint>&, const std::vector<double>&, std::vector<DataPoint>&, const std::vector<double>&);
+	bool update(std::vector<DataPoint>&, const std::vector<double>&, const std::vector<unsigned int>&);
+	// Copy of the trained recommender for copies of the users and the clusters it was trained on
+	CosineLSHRecommender *copy(const std::vector<DataPoint>&, std::vector<DataPoint>&, const std::vector<DataPoint>&, std::vector<DataPoint>&) const;
 	std::vector<unsigned int> recommendations(const DataPoint&, const std::set<unsigned int>&) const;
+	std::vector< std::vector<unsigned int> > recommendations(const std::vector<const DataPoint *>&, const std::vector<const std::set<unsigned int> *>&) const;
 	std::vector< std::pair<double, unsigned int> > userBasedPredictions(const DataPoint&, const std::set<unsigned int>&) const;
 	std::vector< std::pair<double, unsigned int> > clusterBasedPredictions(const DataPoint&, const std::set<unsigned int>&) const;
 
 	~CosineLSHRecommender() {
-		if (userLSH != NULL) {
-			delete userLSH;
+		if (userSearch != NULL) {
+			delete userSearch;
 		}
-		if (clusterLSH != NULL) {
-			delete clusterLSH;
+		if (clusterSearch != NULL) {
+			delete clusterSearch;
 		}
 	}
 };
@@ -166,6 +166,13 @@ void DataPoint::add(const DataPoint& p) {
 }
 
 
+/* Replace the coordinates with the given ones (same number of dimensions) */
+void DataPoint::assign(const double *values) {
+	x.assign(values, values + x.size());
+	norm = calculateNorm();
+}
+
+
 void DataPoint::divide(double y) {
 	if (y == 0) {
 		return;
@@ -25,6 +25,8 @@ public:
 
 	bool readDataPoint(const std::string&);
 	std::vector<double> getVector() const { return x; }
+	// The coordinates without copying them
+	const double *getData() const { return x.data(); }
 	unsigned int getDimensions() const { return x.size(); }
 	std::string getID() const { return id; }
 	double getNorm() const { return norm; }
@@ -35,6 +37,7 @@ public:
 	double dotProduct(const DataPoint&) const;
 	void add(const DataPoint&);
 	void divide(double);
+	void assign(const double *);
 	double distance(const DataPoint&) const;
 	bool equal(const DataPoint& p) const { return x == p.x; }
 	int findNearest(const std::vector<DataPoint *>&, double&, double (*distFun)(const DataPoint&, const DataPoint&)) const;
@@ -0,0 +1,144 @@
+#include <vector>
+#include <queue>
+#include <utility> // std::pair, std::make_pair
+#include <algorithm> // std::sort
+#include "exact_search.h"
+#include "data_point.h"
+#include "matrix.h"
+
+void ExactSearch::insert(DataPoint& p) {
+	if (p.getDimensions() != dimensions) {
+		return;
+	}
+
+	indices[&p] = points.size();
+	points.push_back(&p);
+	normalized.resize(normalized.size() + dimensions);
+	normalize(p, &normalized[normalized.size() - dimensions]);
+}
+
+
+void ExactSearch::update(DataPoint& p) {
+	std::unordered_map<const DataPoint *, unsigned int>::const_iterator found = indices.find(&p);
+	if (found != indices.end()) {
+		normalize(p, &normalized[(unsigned long long) found->second * dimensions]);
+	}
+}
+
+
+/* Write the unit vector of the point (or zeros for the zero vector) */
+void ExactSearch::normalize(const DataPoint& p, double *result) const {
+	double norm = p.getNorm();
+	for (unsigned int j = 0; j < dimensions; j++) {
+		result[j] = (norm > 0) ? p.at(j) / norm : 0.0;
+	}
+}
+
+
+void ExactSearch::findNearestNeighbors(const DataPoint& q, unsigned int K, std::vector<DataPoint *>& results, std::vector<double>& distances) const {
+	std::vector<const DataPoint *> queries(1, &q);
+	std::vector< std::vector<DataPoint *> > batchResults;
+	std::vector< std::vector<double> > batchDistances;
+	findNearestNeighborsBatch(queries, K, batchResults, batchDistances);
+
+	results.insert(results.end(), batchResults[0].begin(), batchResults[0].end());
+	distances.insert(distances.end(), batchDistances[0].begin(), batchDistances[0].end());
+}
+
+
+/* Compute the cosine similarity of every query of a block with every point one
+ * tile of points at a time and keep the K closest points of each query in a heap */
+void ExactSearch::findNearestNeighborsBatch(const std::vector<const DataPoint *>& queries, unsigned int K, std::vector< std::vector<DataPoint *> >& results, std::vector< std::vector<double> >& distances) const {
+	results.clear();
+	distances.clear();
+	results.resize(queries.size());
+	distances.resize(queries.size());
+	if (points.size() == 0 || K == 0) {
+		return;
+	}
+
+	std::vector<double> block(QUERY_BLOCK_SIZE * dimensions);
+	std::vector<double> products(QUERY_BLOCK_SIZE * POINT_BLOCK_SIZE);
+
+	for (unsigned int start = 0; start < queries.size(); start += QUERY_BLOCK_SIZE) {
+		unsigned int end = (start + QUERY_BLOCK_SIZE < queries.size()) ? start + QUERY_BLOCK_SIZE : queries.size();
+		unsigned int blockSize = end - start;
+
+		for (unsigned int b = start; b < end; b++) {
+			if (queries[b]->getDimensions() == dimensions) {
+				normalize(*queries[b], &block[(b - start) * dimensions]);
+			}
+		}
+
+		// Max-heap of the K closest points found so far for each query
+		std::vector< std::priority_queue< std::pair<double, unsigned int> > > closest(blockSize);
+
+		for (unsigned int pointStart = 0; pointStart < points.size(); pointStart += POINT_BLOCK_SIZE) {
+			unsigned int pointEnd = (pointStart + POINT_BLOCK_SIZE < points.size()) ? pointStart + POINT_BLOCK_SIZE : points.size();
+			unsigned int tileSize = pointEnd - pointStart;
+
+			multiplyTransposed(&block[0], blockSize, &normalized[(unsigned long long) pointStart * dimensions], tileSize, dimensions, &products[0]);
+
+			for (unsigned int b = 0; b < blockSize; b++) {
+				if (queries[start + b]->getDimensions() != dimensions) {
+					continue;
+				}
+
+				std::priority_queue< std::pair<double, unsigned int> >& heap = closest[b];
+				for (unsigned int i = 0; i < tileSize; i++) {
+					// Same as the cosine distance
+					double dist = 1 - products[b * tileSize + i];
+					if (dist < 0.0000000001) {
+						dist = 0;
+					}
+
+					if (heap.size() < K) {
+						heap.push(std::make_pair(dist, pointStart + i));
+					} else if (dist < heap.top().first) {
+						heap.pop();
+						heap.push(std::make_pair(dist, pointStart + i));
+					}
+				}
+			}
+		}
+
+		// Get the neighbors of every query in increasing distance
+		for (unsigned int b = 0; b < blockSize; b++) {
+			std::vector< std::pair<double, unsigned int> > sorted;
+			while (!closest[b].empty()) {
+				sorted.push_back(closest[b].top());
+				closest[b].pop();
+			}
+			std::sort(sorted.begin(), sorted.end());
+
+			for (unsigned int i = 0; i < sorted.size(); i++) {
+				results[start + b].push_back(points[sorted[i].second]);
+				distances[start + b].push_back(sorted[i].first);
+			}
+		}
+	}
+}
+
+
+unsigned long long ExactSearch::getSize() const {
+	unsigned long long total = 0;
+	total += sizeof(dimensions);
+	total += sizeof(points);
+	total += points.size() * sizeof(DataPoint *);
+	total += indices.size() * (sizeof(const DataPoint *) + sizeof(unsigned int));
+	total += sizeof(normalized);
+	total += normalized.size() * sizeof(double);
+	return total;
+}
+
+
+NeighborSearch *ExactSearch::copy(const std::vector<DataPoint>& from, std::vector<DataPoint>& to) const {
+	ExactSearch *result = new ExactSearch(dimensions);
+	result->normalized = normalized;
+	for (unsigned int i = 0; i < points.size(); i++) {
+		DataPoint *p = movePoint(points[i], from, to);
+		result->indices[p] = i;
+		result->points.push_back(p);
+	}
+	return result;
+}
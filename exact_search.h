@@ -0,0 +1,37 @@
+#ifndef EXACT_SEARCH_H
+#define EXACT_SEARCH_H
+
+#include <vector>
+#include <unordered_map>
+#include "neighbor_search.h"
+#include "data_point.h"
+
+/* Brute force cosine nearest neighbor search over a matrix of normalized points.
+ * Gives exact results so it is also used as the baseline for the recall of the other indexes */
+class ExactSearch: public NeighborSearch {
+private:
+	// Number of queries and points multiplied together in a batch
+	static const unsigned int QUERY_BLOCK_SIZE = 64;
+	static const unsigned int POINT_BLOCK_SIZE = 1024;
+
+	unsigned int dimensions;
+	std::vector<DataPoint *> points;
+	std::unordered_map<const DataPoint *, unsigned int> indices; // Row of every point
+	// Normalized coordinates of every point, one row per point (row-major)
+	std::vector<double> normalized;
+
+
+	void normalize(const DataPoint&, double *) const;
+public:
+	ExactSearch(unsigned int d) : dimensions(d) {}
+
+	void insert(DataPoint&);
+	void update(DataPoint&);
+	void findNearestNeighbors(const DataPoint&, unsigned int, std::vector<DataPoint *>&, std::vector<double>&) const;
+	void findNearestNeighborsBatch(const std::vector<const DataPoint *>&, unsigned int, std::vector< std::vector<DataPoint *> >&, std::vector< std::vector<double> >&) const;
+
+	unsigned long long getSize() const;
+	NeighborSearch *copy(const std::vector<DataPoint>&, std::vector<DataPoint>&) const;
+};
+
+#endif // EXACT_SEARCH_H
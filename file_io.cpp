@@ -12,8 +12,8 @@
 #include "file_io.h"
 #include "util.h"
 
-/* Read the tweets and return the number of tweets read */
-int readInputFile(const char *filename, std::vector<Tweet>& tweets, unsigned int& neighbors) {
+/* Read the tweets (with their times as the third column if timed) and return the number of tweets read */
+int readInputFile(const char *filename, std::vector<Tweet>& tweets, unsigned int& neighbors, bool timed) {
 	// Open file for reading
 	std::ifstream inputFile;
 	inputFile.open(filename);
@@ -54,7 +54,7 @@ int readInputFile(const char *filename, std::vector<Tweet>& tweets, unsigned int
 	} else {
 		// The first line is a tweet
 		Tweet tweet;
-		if (tweet.readTweet(line) == false) {
+		if (tweet.readTweet(line, timed) == false) {
 			return IO_GENERAL_ERROR;
 		}
 
@@ -77,7 +77,7 @@ int readInputFile(const char *filename, std::vector<Tweet>& tweets, unsigned int
 		}
 
 		Tweet tweet;
-		if (tweet.readTweet(line) == false) {
+		if (tweet.readTweet(line, timed) == false) {
 			return IO_GENERAL_ERROR;
 		}
 
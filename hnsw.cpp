@@ -0,0 +1,580 @@
+#include <fstream>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <cmath> // std::log
+#include <utility> // std::pair, std::make_pair
+#include <algorithm> // std::sort, std::find, std::fill
+#include <functional> // std::greater
+#include "hnsw.h"
+#include "data_point.h"
+#include "thread_pool.h"
+
+// Points visited by the current search of each thread
+// (A point is visited when its mark equals the generation of the search)
+struct VisitedList {
+	std::vector<unsigned int> marks;
+	unsigned int generation;
+
+	VisitedList() : generation(0) {}
+};
+
+static thread_local VisitedList visited;
+
+
+/* FNV-1a hash of the normalized coordinates saved with a graph, so a graph
+ * of other points with the same IDs isn't loaded */
+static unsigned long long checksum(const std::vector<double>& values) {
+	unsigned long long hash = 14695981039346656037ULL;
+	const unsigned char *bytes = (const unsigned char *) values.data();
+	for (unsigned long long i = 0; i < values.size() * sizeof(double); i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+
+HNSW::HNSW(unsigned int d, unsigned int MArg, unsigned int efConstructionArg, unsigned int efSearchArg, unsigned int threadsArg)
+		: dimensions(d), M(MArg), maxM0(2 * MArg), efConstruction(efConstructionArg), efSearch(efSearchArg), threads(threadsArg),
+		locking(false), entryPoint(-1), maxLevel(-1) {
+	if (M < 2) {
+		M = 2;
+		maxM0 = 4;
+	}
+	levelMultiplier = 1 / std::log((double) M);
+
+	// Initialize the seed for the random number generator
+	unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count();
+	generator.seed(seed);
+}
+
+
+/* Store the point and choose its level without linking it in the graph */
+void HNSW::addPoint(DataPoint& p) {
+	indices[&p] = points.size();
+	points.push_back(&p);
+	normalized.resize(normalized.size() + dimensions);
+	normalize(p, &normalized[normalized.size() - dimensions]);
+
+	// Level from an exponentially decaying distribution
+	std::uniform_real_distribution<double> distrib(0.0, 1.0);
+	double r = distrib(generator);
+	int level = (r > 0) ? (int) (-std::log(r) * levelMultiplier) : MAX_LEVEL;
+	if (level > MAX_LEVEL) {
+		level = MAX_LEVEL;
+	}
+	levels.push_back(level);
+	links.push_back(std::vector< std::vector<unsigned int> >(level + 1));
+	linkMutexes.emplace_back();
+}
+
+
+void HNSW::insert(DataPoint& p) {
+	if (p.getDimensions() != dimensions) {
+		return;
+	}
+
+	addPoint(p);
+	link(points.size() - 1);
+}
+
+
+/* Insert all the points linking them in the graph in parallel */
+void HNSW::insertAll(std::vector<DataPoint>& newPoints) {
+	unsigned int first = points.size();
+	for (unsigned int i = 0; i < newPoints.size(); i++) {
+		if (newPoints[i].getDimensions() == dimensions) {
+			addPoint(newPoints[i]);
+		}
+	}
+	if (first == points.size()) {
+		return;
+	}
+
+	// The first point of an empty graph is the entry point for the rest
+	if (entryPoint < 0) {
+		link(first);
+		first++;
+	}
+
+	ThreadPool pool(threads);
+	locking = true;
+	pool.parallelFor(points.size() - first, [this, first](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			link(first + i);
+		}
+	});
+	locking = false;
+}
+
+
+/* Link a point whose coordinates changed to its new closest points (it keeps its level).
+ * The links of other points to it are kept: they are still valid edges of the graph */
+void HNSW::update(DataPoint& p) {
+	std::unordered_map<const DataPoint *, unsigned int>::const_iterator found = indices.find(&p);
+	if (found == indices.end()) {
+		return;
+	}
+	unsigned int node = found->second;
+	normalize(p, &normalized[(unsigned long long) node * dimensions]);
+
+	// The search can't start from the point itself, so the entry point
+	// moves to its neighbor on the highest level with links
+	if ((int) node == entryPoint) {
+		int replacement = -1;
+		for (int l = levels[node]; l >= 0 && replacement < 0; l--) {
+			if (links[node][l].size() > 0) {
+				replacement = links[node][l][0];
+			}
+		}
+		if (replacement < 0) { // Only point of the graph
+			return;
+		}
+		entryPoint = replacement;
+		maxLevel = levels[replacement];
+	}
+
+	for (int l = 0; l <= levels[node]; l++) {
+		links[node][l].clear();
+	}
+	link(node);
+}
+
+
+/* Connect a stored point with its closest points on each of its levels */
+void HNSW::link(unsigned int node) {
+	const double *q = &normalized[(unsigned long long) node * dimensions];
+	int level = levels[node];
+
+	// A point above the top level becomes the new entry point so the
+	// insertion is done holding the entry lock
+	std::unique_lock<std::mutex> entryLock(entryMutex);
+	if (entryPoint < 0) {
+		entryPoint = node;
+		maxLevel = level;
+		return;
+	}
+	int currMaxLevel = maxLevel;
+	unsigned int curr = entryPoint;
+	if (level <= currMaxLevel) {
+		entryLock.unlock();
+	}
+
+	// Walk greedily down to the level of the point
+	for (int l = currMaxLevel; l > level; l--) {
+		curr = greedySearch(q, curr, l);
+	}
+
+	for (int l = ((level < currMaxLevel) ? level : currMaxLevel); l >= 0; l--) {
+		std::vector< std::pair<double, unsigned int> > found;
+		searchLayer(q, curr, efConstruction, l, found);
+
+		// The point may already be reachable through links added by other threads
+		std::vector< std::pair<double, unsigned int> > candidates;
+		for (unsigned int i = 0; i < found.size(); i++) {
+			if (found[i].second != node) {
+				candidates.push_back(found[i]);
+			}
+		}
+		if (candidates.size() == 0) {
+			continue;
+		}
+
+		std::vector<unsigned int> neighbors;
+		selectNeighbors(candidates, M, neighbors);
+		{
+			// Keep the links other threads added to this point in the meantime
+			std::unique_lock<std::mutex> lock(linkMutexes[node]);
+			std::vector<unsigned int>& nodeLinks = links[node][l];
+			for (unsigned int i = 0; i < neighbors.size(); i++) {
+				if (std::find(nodeLinks.begin(), nodeLinks.end(), neighbors[i]) == nodeLinks.end()) {
+					nodeLinks.push_back(neighbors[i]);
+				}
+			}
+		}
+
+		// Add the reverse links, pruning the lists that got too long
+		unsigned int maxLinks = (l == 0) ? maxM0 : M;
+		for (unsigned int i = 0; i < neighbors.size(); i++) {
+			unsigned int neighbor = neighbors[i];
+			std::unique_lock<std::mutex> lock(linkMutexes[neighbor]);
+			std::vector<unsigned int>& neighborLinks = links[neighbor][l];
+			neighborLinks.push_back(node);
+			if (neighborLinks.size() <= maxLinks) {
+				continue;
+			}
+
+			const double *p = &normalized[(unsigned long long) neighbor * dimensions];
+			std::vector< std::pair<double, unsigned int> > linkDistances;
+			for (unsigned int j = 0; j < neighborLinks.size(); j++) {
+				linkDistances.push_back(std::make_pair(distance(p, neighborLinks[j]), neighborLinks[j]));
+			}
+			std::sort(linkDistances.begin(), linkDistances.end());
+			selectNeighbors(linkDistances, maxLinks, neighborLinks);
+		}
+
+		curr = candidates[0].second;
+	}
+
+	if (level > currMaxLevel) {
+		entryPoint = node;
+		maxLevel = level;
+	}
+}
+
+
+/* Cosine distance of a normalized vector from a stored point */
+double HNSW::distance(const double *q, unsigned int node) const {
+	const double *p = &normalized[(unsigned long long) node * dimensions];
+	double total = 0.0;
+	for (unsigned int j = 0; j < dimensions; j++) {
+		total += q[j] * p[j];
+	}
+
+	// Problem with double precision (same as the cosine distance)
+	if (1 - total < 0.0000000001) {
+		return 0;
+	}
+	return 1 - total;
+}
+
+
+void HNSW::getLinks(unsigned int node, int level, std::vector<unsigned int>& result) const {
+	if (locking) {
+		std::unique_lock<std::mutex> lock(linkMutexes[node]);
+		result = links[node][level];
+	} else {
+		result = links[node][level];
+	}
+}
+
+
+/* Move to the closest neighbor on the level until no neighbor is closer */
+unsigned int HNSW::greedySearch(const double *q, unsigned int entry, int level) const {
+	unsigned int curr = entry;
+	double currDist = distance(q, curr);
+	bool changed = true;
+	std::vector<unsigned int> neighbors;
+	while (changed) {
+		changed = false;
+		getLinks(curr, level, neighbors);
+		for (unsigned int i = 0; i < neighbors.size(); i++) {
+			double dist = distance(q, neighbors[i]);
+			if (dist < currDist) {
+				currDist = dist;
+				curr = neighbors[i];
+				changed = true;
+			}
+		}
+	}
+	return curr;
+}
+
+
+/* Find the ef closest points of the level starting from the entry point
+ * (Returned in increasing distance) */
+void HNSW::searchLayer(const double *q, unsigned int entry, unsigned int ef, int level, std::vector< std::pair<double, unsigned int> >& results) const {
+	if (visited.marks.size() < points.size()) {
+		visited.marks.resize(points.size(), 0);
+	}
+	visited.generation++;
+	if (visited.generation == 0) { // Overflow: clear the old marks
+		std::fill(visited.marks.begin(), visited.marks.end(), 0);
+		visited.generation = 1;
+	}
+
+	// Closest candidates to expand first
+	std::priority_queue< std::pair<double, unsigned int>, std::vector< std::pair<double, unsigned int> >, std::greater< std::pair<double, unsigned int> > > candidates;
+	// Closest points found so far, farthest on top
+	std::priority_queue< std::pair<double, unsigned int> > closest;
+
+	double entryDist = distance(q, entry);
+	candidates.push(std::make_pair(entryDist, entry));
+	closest.push(std::make_pair(entryDist, entry));
+	visited.marks[entry] = visited.generation;
+
+	std::vector<unsigned int> neighbors;
+	while (!candidates.empty()) {
+		std::pair<double, unsigned int> curr = candidates.top();
+		if (curr.first > closest.top().first && closest.size() >= ef) {
+			break;
+		}
+		candidates.pop();
+
+		getLinks(curr.second, level, neighbors);
+		for (unsigned int i = 0; i < neighbors.size(); i++) {
+			unsigned int neighbor = neighbors[i];
+			if (visited.marks[neighbor] == visited.generation) {
+				continue;
+			}
+			visited.marks[neighbor] = visited.generation;
+
+			double dist = distance(q, neighbor);
+			if (closest.size() < ef || dist < closest.top().first) {
+				candidates.push(std::make_pair(dist, neighbor));
+				closest.push(std::make_pair(dist, neighbor));
+				if (closest.size() > ef) {
+					closest.pop();
+				}
+			}
+		}
+	}
+
+	results.resize(closest.size());
+	for (int i = closest.size() - 1; i >= 0; i--) {
+		results[i] = closest.top();
+		closest.pop();
+	}
+}
+
+
+/* Choose up to maxLinks neighbors from the candidates (sorted by distance), preferring
+ * the candidates that are closer to the point than to the already chosen neighbors
+ * so that the links point to different directions */
+void HNSW::selectNeighbors(const std::vector< std::pair<double, unsigned int> >& candidates, unsigned int maxLinks, std::vector<unsigned int>& result) const {
+	std::vector<unsigned int> selected;
+	std::vector<unsigned int> pruned;
+	for (unsigned int i = 0; i < candidates.size() && selected.size() < maxLinks; i++) {
+		const double *c = &normalized[(unsigned long long) candidates[i].second * dimensions];
+		bool good = true;
+		for (unsigned int j = 0; j < selected.size(); j++) {
+			if (distance(c, selected[j]) < candidates[i].first) {
+				good = false;
+				break;
+			}
+		}
+
+		if (good) {
+			selected.push_back(candidates[i].second);
+		} else {
+			pruned.push_back(candidates[i].second);
+		}
+	}
+
+	// Keep the closest pruned candidates if there are free links
+	for (unsigned int i = 0; i < pruned.size() && selected.size() < maxLinks; i++) {
+		selected.push_back(pruned[i]);
+	}
+
+	result.swap(selected);
+}
+
+
+/* Write the unit vector of the point (or zeros for the zero vector) */
+void HNSW::normalize(const DataPoint& p, double *result) const {
+	double norm = p.getNorm();
+	for (unsigned int j = 0; j < dimensions; j++) {
+		result[j] = (norm > 0) ? p.at(j) / norm : 0.0;
+	}
+}
+
+
+void HNSW::findNearestNeighbors(const DataPoint& q, unsigned int K, std::vector<DataPoint *>& results, std::vector<double>& distances) const {
+	if (entryPoint < 0 || q.getDimensions() != dimensions || K == 0) {
+		return;
+	}
+
+	std::vector<double> query(dimensions);
+	normalize(q, &query[0]);
+
+	unsigned int curr = entryPoint;
+	for (int l = maxLevel; l > 0; l--) {
+		curr = greedySearch(&query[0], curr, l);
+	}
+
+	std::vector< std::pair<double, unsigned int> > closest;
+	searchLayer(&query[0], curr, (efSearch > K) ? efSearch : K, 0, closest);
+	for (unsigned int i = 0; i < closest.size() && i < K; i++) {
+		results.push_back(points[closest[i].second]);
+		distances.push_back(closest[i].first);
+	}
+}
+
+
+/* Save the graph to a binary file. The points are identified by their IDs */
+bool HNSW::save(const char *filename) const {
+	std::ofstream file(filename, std::ofstream::binary);
+	if (!file) {
+		return false;
+	}
+
+	unsigned int version = FILE_VERSION;
+	unsigned int n = points.size();
+	unsigned long long hash = checksum(normalized);
+	file.write("HNSW", 4);
+	file.write((const char *) &version, sizeof(version));
+	file.write((const char *) &n, sizeof(n));
+	file.write((const char *) &dimensions, sizeof(dimensions));
+	file.write((const char *) &M, sizeof(M));
+	file.write((const char *) &maxM0, sizeof(maxM0));
+	file.write((const char *) &entryPoint, sizeof(entryPoint));
+	file.write((const char *) &maxLevel, sizeof(maxLevel));
+	file.write((const char *) &hash, sizeof(hash));
+
+	for (unsigned int i = 0; i < n; i++) {
+		std::string id = points[i]->getID();
+		unsigned int length = id.size();
+		file.write((const char *) &length, sizeof(length));
+		file.write(id.c_str(), length);
+
+		file.write((const char *) &levels[i], sizeof(levels[i]));
+		for (int l = 0; l <= levels[i]; l++) {
+			unsigned int count = links[i][l].size();
+			file.write((const char *) &count, sizeof(count));
+			if (count > 0) {
+				file.write((const char *) &links[i][l][0], count * sizeof(unsigned int));
+			}
+		}
+	}
+
+	return (bool) file;
+}
+
+
+/* Load a graph saved for the given points (same points in the same order
+ * with the same coordinates) */
+bool HNSW::load(const char *filename, std::vector<DataPoint>& dataPoints) {
+	std::ifstream file(filename, std::ifstream::binary);
+	if (!file) {
+		return false;
+	}
+
+	char magic[4];
+	unsigned int version;
+	unsigned int n;
+	unsigned int fileDimensions;
+	unsigned int fileM;
+	unsigned int fileMaxM0;
+	int fileEntryPoint;
+	int fileMaxLevel;
+	unsigned long long fileHash;
+	file.read(magic, 4);
+	file.read((char *) &version, sizeof(version));
+	file.read((char *) &n, sizeof(n));
+	file.read((char *) &fileDimensions, sizeof(fileDimensions));
+	file.read((char *) &fileM, sizeof(fileM));
+	file.read((char *) &fileMaxM0, sizeof(fileMaxM0));
+	file.read((char *) &fileEntryPoint, sizeof(fileEntryPoint));
+	file.read((char *) &fileMaxLevel, sizeof(fileMaxLevel));
+	file.read((char *) &fileHash, sizeof(fileHash));
+	if (!file || std::string(magic, 4) != "HNSW" || version != FILE_VERSION) {
+		return false;
+	}
+	if (n != dataPoints.size() || fileDimensions != dimensions || fileMaxLevel > MAX_LEVEL || fileEntryPoint >= (int) n) {
+		return false;
+	}
+
+	std::vector<int> newLevels(n);
+	std::vector< std::vector< std::vector<unsigned int> > > newLinks(n);
+	for (unsigned int i = 0; i < n; i++) {
+		unsigned int length;
+		file.read((char *) &length, sizeof(length));
+		if (!file || length > dataPoints[i].getID().size()) {
+			return false;
+		}
+		std::string id(length, ' ');
+		if (length > 0) {
+			file.read(&id[0], length);
+		}
+		// The points must match the saved ones
+		if (id != dataPoints[i].getID() || dataPoints[i].getDimensions() != dimensions) {
+			return false;
+		}
+
+		file.read((char *) &newLevels[i], sizeof(newLevels[i]));
+		if (!file || newLevels[i] < 0 || newLevels[i] > MAX_LEVEL) {
+			return false;
+		}
+		newLinks[i].resize(newLevels[i] + 1);
+		for (int l = 0; l <= newLevels[i]; l++) {
+			unsigned int count;
+			file.read((char *) &count, sizeof(count));
+			if (!file || count > n) {
+				return false;
+			}
+			newLinks[i][l].resize(count);
+			if (count > 0) {
+				file.read((char *) &newLinks[i][l][0], count * sizeof(unsigned int));
+			}
+			for (unsigned int j = 0; j < count; j++) {
+				if (newLinks[i][l][j] >= n) {
+					return false;
+				}
+			}
+		}
+	}
+	if (!file) {
+		return false;
+	}
+
+	// The graph was saved for other coordinates (for example older ratings of the users)
+	std::vector<double> newNormalized((unsigned long long) n * dimensions);
+	for (unsigned int i = 0; i < n; i++) {
+		normalize(dataPoints[i], &newNormalized[(unsigned long long) i * dimensions]);
+	}
+	if (checksum(newNormalized) != fileHash) {
+		return false;
+	}
+
+	// Replace the current graph
+	M = fileM;
+	maxM0 = fileMaxM0;
+	levelMultiplier = 1 / std::log((double) M);
+	entryPoint = fileEntryPoint;
+	maxLevel = fileMaxLevel;
+	levels.swap(newLevels);
+	links.swap(newLinks);
+
+	points.clear();
+	indices.clear();
+	normalized.swap(newNormalized);
+	linkMutexes.clear();
+	for (unsigned int i = 0; i < n; i++) {
+		indices[&dataPoints[i]] = i;
+		points.push_back(&dataPoints[i]);
+		linkMutexes.emplace_back();
+	}
+
+	return true;
+}
+
+
+unsigned long long HNSW::getSize() const {
+	unsigned long long total = 0;
+	total += sizeof(*this);
+	total += points.size() * sizeof(DataPoint *);
+	total += indices.size() * (sizeof(const DataPoint *) + sizeof(unsigned int));
+	total += normalized.size() * sizeof(double);
+	total += levels.size() * sizeof(int);
+	total += linkMutexes.size() * sizeof(std::mutex);
+	for (unsigned int i = 0; i < links.size(); i++) {
+		total += links[i].size() * sizeof(std::vector<unsigned int>);
+		for (unsigned int l = 0; l < links[i].size(); l++) {
+			total += links[i][l].size() * sizeof(unsigned int);
+		}
+	}
+	return total;
+}
+
+
+
+/* The graph is copied as it is (only the points move) */
+NeighborSearch *HNSW::copy(const std::vector<DataPoint>& from, std::vector<DataPoint>& to) const {
+	HNSW *result = new HNSW(dimensions, M, efConstruction, efSearch, threads);
+	result->generator = generator;
+	result->normalized = normalized;
+	result->levels = levels;
+	result->links = links;
+	result->entryPoint = entryPoint;
+	result->maxLevel = maxLevel;
+	for (unsigned int i = 0; i < points.size(); i++) {
+		DataPoint *p = movePoint(points[i], from, to);
+		result->indices[p] = i;
+		result->points.push_back(p);
+		result->linkMutexes.emplace_back();
+	}
+	return result;
+}
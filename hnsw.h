@@ -0,0 +1,73 @@
+#ifndef HNSW_H
+#define HNSW_H
+
+#include <vector>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <utility> // std::pair
+#include "neighbor_search.h"
+#include "data_point.h"
+
+/* Hierarchical Navigable Small World graph for approximate cosine nearest neighbor search.
+ * Every point is linked to its closest points on each level up to a random level of its own
+ * and the queries greedily walk the graph from the top level down to level 0 */
+class HNSW: public NeighborSearch {
+private:
+	static const int MAX_LEVEL = 16;
+	static const unsigned int FILE_VERSION = 2;
+
+	unsigned int dimensions;
+	unsigned int M; // Links per point on the upper levels
+	unsigned int maxM0; // Links per point on level 0
+	unsigned int efConstruction; // Candidates kept while inserting
+	unsigned int efSearch; // Candidates kept while querying
+	unsigned int threads; // Threads used by insertAll
+	double levelMultiplier;
+	std::default_random_engine generator;
+
+	std::vector<DataPoint *> points;
+	std::unordered_map<const DataPoint *, unsigned int> indices; // Node of every point
+	// Normalized coordinates of every point, one row per point (row-major)
+	std::vector<double> normalized;
+	std::vector<int> levels;
+	// links[i][l] are the neighbors of point i on level l
+	std::vector< std::vector< std::vector<unsigned int> > > links;
+
+	// Locks of the links of every point (only used while inserting in parallel)
+	mutable std::deque<std::mutex> linkMutexes;
+	bool locking;
+	std::mutex entryMutex;
+
+	int entryPoint;
+	int maxLevel;
+
+
+	void addPoint(DataPoint&);
+	void link(unsigned int);
+	double distance(const double *, unsigned int) const;
+	void getLinks(unsigned int, int, std::vector<unsigned int>&) const;
+	unsigned int greedySearch(const double *, unsigned int, int) const;
+	void searchLayer(const double *, unsigned int, unsigned int, int, std::vector< std::pair<double, unsigned int> >&) const;
+	void selectNeighbors(const std::vector< std::pair<double, unsigned int> >&, unsigned int, std::vector<unsigned int>&) const;
+	void normalize(const DataPoint&, double *) const;
+public:
+	HNSW(unsigned int d, unsigned int MArg = 16, unsigned int efConstructionArg = 200, unsigned int efSearchArg = 50, unsigned int threadsArg = 0);
+
+	void insert(DataPoint&);
+	void insertAll(std::vector<DataPoint>&);
+	void update(DataPoint&);
+	void findNearestNeighbors(const DataPoint&, unsigned int, std::vector<DataPoint *>&, std::vector<double>&) const;
+
+	void setEfSearch(unsigned int ef) { efSearch = ef; }
+	unsigned int getEfSearch() const { return efSearch; }
+
+	bool save(const char *) const;
+	bool load(const char *, std::vector<DataPoint>&);
+
+	unsigned long long getSize() const;
+	NeighborSearch *copy(const std::vector<DataPoint>&, std::vector<DataPoint>&) const;
+};
+
+#endif // HNSW_H
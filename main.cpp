@@ -6,38 +6,81 @@
 #include <utility> // pair
 #include <cstring> // strcmp, strncpy
 #include <climits> // PATH_MAX
-#include <ctime> // clock
+#include <cstdlib> // atoi, atof
+#include <chrono>
+#include <functional>
+#include <algorithm> // sort
+#include <csignal> // signal
+#include <cmath> // ceil
 #include "tweet.h"
 #include "recommendation.h"
 #include "file_io.h"
+#include "neighbor_search.h"
 #include "util.h"
+#include "thread_pool.h"
+#include "server.h"
+#include "sentiment_aggregator.h"
 
 #define SENTIMENT_LEXICON "datasets/vader_lexicon.csv"
 #define COINS_FILE        "datasets/coins_queries.csv"
 #define ALPHA 15
+// Users queried together by the batched Cosine LSH recommendations
+#define QUERY_BATCH_SIZE 32
 
 using namespace std;
 
+typedef vector< pair<unsigned int, vector<string> > > UserResults;
+
 static void usage(char *);
+static double runQueries(const char *, const vector<unsigned int>&, unsigned int, const function<vector< vector<string> >(const vector<unsigned int>&)>&,
+		ThreadPool&, UserResults&);
+static double percentile(const vector<double>&, double);
+static void stopServer(int);
+
+// Server stopped by SIGINT and SIGTERM
+static RecommendationServer *server = NULL;
 
 int main(int argc, char *argv[]) {
 	// Parse command line arguments
 	bool got_input_file = false;
 	bool got_output_file = false;
 	bool got_validate = false;
+	bool got_search = false;
+	bool got_graph = false;
+	bool got_threads = false;
+	bool got_socket = false;
+	bool got_hnsw_m = false;
+	bool got_ef_construction = false;
+	bool got_ef_search = false;
+	bool got_signature = false;
+	bool got_rerank = false;
+	bool got_projections = false;
+	bool got_streaming = false;
+	bool got_chunk = false;
+	bool got_tweet_clusters = false;
+	bool got_lsh_assignment = false;
+	bool got_clustering = false;
+	bool got_init = false;
+	bool got_assignment = false;
+	bool got_aggregation = false;
+	bool got_period = false;
+	unsigned int threads = 0; // Every hardware thread
+	int searchMethod = NeighborSearch::LSH_SEARCH;
+	RecommendationParameters parameters;
+	int aggregation = SentimentAggregator::SUM_AGGREGATION;
+	double period = 0.0; // Half-life or window (in the unit of the times of the tweets)
 
 	char inputFile[PATH_MAX];
 	char outputFile[PATH_MAX];
+	char graphPrefix[PATH_MAX] = "";
+	char socketPath[PATH_MAX];
 
-	if (argc > 6) {
-		usage(argv[0]);
-		return -1;
-	}
-
-
+	// Every option is given once and takes one value, apart from -validate
 	int i;
-	for (i = 1; i < argc; i += 2) {
-		if (strcmp(argv[i], "-d") == 0 && !got_input_file) {
+	int consumed; // Arguments of the current option
+	for (i = 1; i < argc; i += consumed) {
+		consumed = 2;
+		if (strcmp(argv[i], "-d") == 0 && !got_input_file && i + 1 < argc) {
 			got_input_file = true;
 			strncpy(inputFile, argv[i+1], PATH_MAX-1);
 			inputFile[PATH_MAX-1] = '\0';
@@ -46,12 +89,166 @@ int main(int argc, char *argv[]) {
 				cerr << "[-] Input file: " << inputFile << " is not accessible" << endl;
 				return -1;
 			}
-		} else if (strcmp(argv[i], "-o") == 0 && !got_output_file) {
+		} else if (strcmp(argv[i], "-o") == 0 && !got_output_file && i + 1 < argc) {
 			got_output_file = true;
 			strncpy(outputFile, argv[i+1], PATH_MAX-1);
 			outputFile[PATH_MAX-1] = '\0';
+		} else if (strcmp(argv[i], "-search") == 0 && !got_search && i + 1 < argc) {
+			got_search = true;
+			if (strcmp(argv[i+1], "lsh") == 0) {
+				searchMethod = NeighborSearch::LSH_SEARCH;
+			} else if (strcmp(argv[i+1], "exact") == 0) {
+				searchMethod = NeighborSearch::EXACT_SEARCH;
+			} else if (strcmp(argv[i+1], "hnsw") == 0) {
+				searchMethod = NeighborSearch::HNSW_SEARCH;
+			} else {
+				usage(argv[0]);
+				return -1;
+			}
+		} else if (strcmp(argv[i], "-graph") == 0 && !got_graph && i + 1 < argc) {
+			got_graph = true;
+			strncpy(graphPrefix, argv[i+1], PATH_MAX-1);
+			graphPrefix[PATH_MAX-1] = '\0';
+		} else if (strcmp(argv[i], "-threads") == 0 && !got_threads && i + 1 < argc) {
+			got_threads = true;
+			if (!isNumber(argv[i+1]) || atoi(argv[i+1]) < 0) {
+				usage(argv[0]);
+				return -1;
+			}
+			threads = atoi(argv[i+1]);
+		} else if (strcmp(argv[i], "-serve") == 0 && !got_socket && i + 1 < argc) {
+			got_socket = true;
+			strncpy(socketPath, argv[i+1], PATH_MAX-1);
+			socketPath[PATH_MAX-1] = '\0';
+		} else if (strcmp(argv[i], "-hnswM") == 0 && !got_hnsw_m && i + 1 < argc) {
+			got_hnsw_m = true;
+			if (!isNumber(argv[i+1]) || atoi(argv[i+1]) < 2) {
+				usage(argv[0]);
+				return -1;
+			}
+			parameters.hnswM = atoi(argv[i+1]);
+		} else if (strcmp(argv[i], "-efConstruction") == 0 && !got_ef_construction && i + 1 < argc) {
+			got_ef_construction = true;
+			if (!isNumber(argv[i+1]) || atoi(argv[i+1]) < 1) {
+				usage(argv[0]);
+				return -1;
+			}
+			parameters.hnswEfConstruction = atoi(argv[i+1]);
+		} else if (strcmp(argv[i], "-efSearch") == 0 && !got_ef_search && i + 1 < argc) {
+			got_ef_search = true;
+			if (!isNumber(argv[i+1]) || atoi(argv[i+1]) < 1) {
+				usage(argv[0]);
+				return -1;
+			}
+			parameters.hnswEfSearch = atoi(argv[i+1]);
+		} else if (strcmp(argv[i], "-signature") == 0 && !got_signature && i + 1 < argc) {
+			got_signature = true;
+			if (!isNumber(argv[i+1]) || atoi(argv[i+1]) < 0) {
+				usage(argv[0]);
+				return -1;
+			}
+			parameters.signatureBits = atoi(argv[i+1]);
+		} else if (strcmp(argv[i], "-rerank") == 0 && !got_rerank && i + 1 < argc) {
+			got_rerank = true;
+			if (!isNumber(argv[i+1]) || atoi(argv[i+1]) < 0) {
+				usage(argv[0]);
+				return -1;
+			}
+			parameters.rerankSize = atoi(argv[i+1]);
+		} else if (strcmp(argv[i], "-projections") == 0 && !got_projections && i + 1 < argc) {
+			got_projections = true;
+			if (strcmp(argv[i+1], "gaussian") == 0) {
+				parameters.structuredProjections = false;
+			} else if (strcmp(argv[i+1], "hadamard") == 0) {
+				parameters.structuredProjections = true;
+			} else {
+				usage(argv[0]);
+				return -1;
+			}
+		} else if (strcmp(argv[i], "-streaming") == 0 && !got_streaming && i + 1 < argc) {
+			got_streaming = true;
+			if (!isNumber(argv[i+1]) || atoi(argv[i+1]) < 0) {
+				usage(argv[0]);
+				return -1;
+			}
+			// Given in MiB (0 to always read the processed tweets in chunks)
+			parameters.streamingFileSize = (unsigned long long) atoi(argv[i+1]) << 20;
+		} else if (strcmp(argv[i], "-chunk") == 0 && !got_chunk && i + 1 < argc) {
+			got_chunk = true;
+			if (!isNumber(argv[i+1]) || atoi(argv[i+1]) < 1) {
+				usage(argv[0]);
+				return -1;
+			}
+			parameters.streamingChunkSize = atoi(argv[i+1]);
+		} else if (strcmp(argv[i], "-tweetClusters") == 0 && !got_tweet_clusters && i + 1 < argc) {
+			got_tweet_clusters = true;
+			if (!isNumber(argv[i+1]) || atoi(argv[i+1]) < 2) {
+				usage(argv[0]);
+				return -1;
+			}
+			parameters.tweetClusters = atoi(argv[i+1]);
+		} else if (strcmp(argv[i], "-lshAssignment") == 0 && !got_lsh_assignment && i + 1 < argc) {
+			got_lsh_assignment = true;
+			if (!isNumber(argv[i+1]) || atoi(argv[i+1]) < 0) {
+				usage(argv[0]);
+				return -1;
+			}
+			// Minimum number of tweet clusters (0 to always use it)
+			parameters.lshAssignmentClusters = atoi(argv[i+1]);
+		} else if (strcmp(argv[i], "-clustering") == 0 && !got_clustering && i + 1 < argc) {
+			got_clustering = true;
+			if (strcmp(argv[i+1], "kmeans") == 0) {
+				parameters.bisecting = false;
+			} else if (strcmp(argv[i+1], "bisecting") == 0) {
+				parameters.bisecting = true;
+			} else {
+				usage(argv[0]);
+				return -1;
+			}
+		} else if (strcmp(argv[i], "-init") == 0 && !got_init && i + 1 < argc) {
+			got_init = true;
+			if (strcmp(argv[i+1], "random") == 0) {
+				parameters.userInitialization = KMeansClustering::RANDOM_INIT;
+			} else if (strcmp(argv[i+1], "kmeans++") == 0) {
+				parameters.userInitialization = KMeansClustering::KMEANS_PP_INIT;
+			} else if (strcmp(argv[i+1], "kmeans||") == 0) {
+				parameters.userInitialization = KMeansClustering::KMEANS_PARALLEL_INIT;
+			} else {
+				usage(argv[0]);
+				return -1;
+			}
+		} else if (strcmp(argv[i], "-assignment") == 0 && !got_assignment && i + 1 < argc) {
+			got_assignment = true;
+			if (strcmp(argv[i+1], "plain") == 0) {
+				parameters.boundedAssignment = false;
+			} else if (strcmp(argv[i+1], "bounded") == 0) {
+				parameters.boundedAssignment = true;
+			} else {
+				usage(argv[0]);
+				return -1;
+			}
+		} else if (strcmp(argv[i], "-aggregation") == 0 && !got_aggregation && i + 1 < argc) {
+			got_aggregation = true;
+			if (strcmp(argv[i+1], "sum") == 0) {
+				aggregation = SentimentAggregator::SUM_AGGREGATION;
+			} else if (strcmp(argv[i+1], "decay") == 0) {
+				aggregation = SentimentAggregator::DECAYED_AGGREGATION;
+			} else if (strcmp(argv[i+1], "window") == 0) {
+				aggregation = SentimentAggregator::WINDOW_AGGREGATION;
+			} else {
+				usage(argv[0]);
+				return -1;
+			}
+		} else if (strcmp(argv[i], "-period") == 0 && !got_period && i + 1 < argc) {
+			got_period = true;
+			if (!isNumber(argv[i+1]) || atof(argv[i+1]) <= 0) {
+				usage(argv[0]);
+				return -1;
+			}
+			period = atof(argv[i+1]);
 		} else if (strcmp(argv[i], "-validate") == 0 && !got_validate) {
 			got_validate = true;
+			consumed = 1;
 		} else {
 			usage(argv[0]);
 			return -1;
@@ -59,7 +256,9 @@ int main(int argc, char *argv[]) {
 	}
 
 
-	if (!got_input_file || !got_output_file) {
+	// The server mode answers requests instead of writing the output file.
+	// The time-based aggregations need the half-life or the window
+	if (!got_input_file || (!got_output_file && !got_socket) || (aggregation != SentimentAggregator::SUM_AGGREGATION && !got_period)) {
 		usage(argv[0]);
 		return -1;
 	}
@@ -71,7 +270,8 @@ int main(int argc, char *argv[]) {
 	// Read input file
 	unsigned int neighbors = 20;
 	int res;
-	if ((res = readInputFile(inputFile, tweets, neighbors)) == IO_GENERAL_ERROR) {
+	// The third column is the time of the tweet for the time-based aggregations
+	if ((res = readInputFile(inputFile, tweets, neighbors, aggregation != SentimentAggregator::SUM_AGGREGATION)) == IO_GENERAL_ERROR) {
 		cerr << "[-] Error while reading input file: " << inputFile << endl;
 		return -1;
 	} else if (res == IO_NOT_UNIQUE) {
@@ -109,9 +309,22 @@ int main(int argc, char *argv[]) {
 
 
 	// Create recommendation system
-	Recommendation *rec = new Recommendation(tweets, neighbors, ClusteringRecommender::DEFAULT_CLUSTERS, 10);
+	Recommendation *rec = new Recommendation(tweets, neighbors, ClusteringRecommender::DEFAULT_CLUSTERS, 10, searchMethod, graphPrefix,
+		aggregation, period, parameters);
 	//Recommendation *rec = new Recommendation(tweets, neighbors, 10, 2);
 
+	if (got_socket) {
+		// Answer requests with the trained model until stopped
+		server = new RecommendationServer(*rec, coins, sentimentMap, ALPHA, socketPath, threads);
+		signal(SIGINT, stopServer);
+		signal(SIGTERM, stopServer);
+		bool served = server->run();
+		delete server;
+		server = NULL;
+		delete rec;
+		return served ? 0 : -1;
+	}
+
 	// Remove previous contents of the output file
 	if (emptyFile(outputFile) == false) {
 		cerr << "[-] Couln't write to the output file: " << outputFile << endl;
@@ -119,32 +332,24 @@ int main(int argc, char *argv[]) {
 	}
 
 
-	clock_t start;
-	clock_t end;
+	// Spread the users over a pool of threads (the results keep the order of the users)
+	ThreadPool pool(threads);
+	vector<unsigned int> users(userIDs.begin(), userIDs.end());
 
 	// Cosine LSH results
-	double cosineLSHTime = 0.0;
-	vector< pair<unsigned int, vector<string> > > cosineLSHResults;
+	UserResults cosineLSHResults;
 	cout << "\n[*] Running Cosine LSH Recommendations" << endl;
-	for (auto user : userIDs) {
-		start = clock();
-		vector<string> results = rec->cosineLSHRecommendations(user, coins);
-		end = clock();
-		cosineLSHTime += ((double) (end - start)) / (CLOCKS_PER_SEC / 1000);
-		cosineLSHResults.push_back(make_pair(user, results));
-	}
+	// Query the users in batches (sharing the hashing of the users)
+	double cosineLSHTime = runQueries("Cosine LSH", users, QUERY_BATCH_SIZE, [&](const vector<unsigned int>& batch) {
+		return rec->cosineLSHRecommendations(batch, coins);
+	}, pool, cosineLSHResults);
 
 	// Clustering results
-	double clusteringTime = 0.0;
-	vector< pair<unsigned int, vector<string> > > clusteringResults;
+	UserResults clusteringResults;
 	cout << "[*] Running Clustering Recommendations" << endl;
-	for (auto& user : userIDs) {
-		start = clock();
-		vector<string> results = rec->clusteringRecommendations(user, coins);
-		end = clock();
-		clusteringTime += ((double) (end - start)) / (CLOCKS_PER_SEC / 1000);
-		clusteringResults.push_back(make_pair(user, results));
-	}
+	double clusteringTime = runQueries("Clustering", users, 1, [&](const vector<unsigned int>& batch) {
+		return vector< vector<string> >(1, rec->clusteringRecommendations(batch[0], coins));
+	}, pool, clusteringResults);
 
 	if (writeOutputFile(outputFile, cosineLSHResults, cosineLSHTime, clusteringResults, clusteringTime) == false) {
 		cerr << "[-] Error while writing to the output file: " << outputFile << endl;
@@ -167,5 +372,73 @@ int main(int argc, char *argv[]) {
 
 
 void usage(char *name) {
-	cout << "Usage: " << name << " -d <input file> -o <output file> [-validate]" << endl;
+	cout << "Usage: " << name << " -d <input file> -o <output file> [-search lsh|exact|hnsw] [-graph <HNSW graph file prefix>]"
+		<< " [-hnswM <links per point>] [-efConstruction <candidates>] [-efSearch <candidates>]"
+		<< " [-signature <LSH signature bits>] [-rerank <candidates>] [-projections gaussian|hadamard]"
+		<< " [-streaming <file size in MiB>] [-chunk <points>] [-tweetClusters <number of clusters>] [-lshAssignment <min clusters>]"
+		<< " [-clustering kmeans|bisecting] [-init random|kmeans++|kmeans||] [-assignment plain|bounded]"
+		<< " [-aggregation sum|decay|window] [-period <half-life or window>]"
+		<< " [-threads <number of threads>] [-serve <socket path>] [-validate]" << endl;
+}
+
+
+
+/* Run the queries of the users in batches of the given size on the pool and save the
+ * results in the order of the users. Prints the throughput and the percentiles of the
+ * latency of a query (the time until its batch finished). Returns the wall-clock time (ms) */
+double runQueries(const char *name, const vector<unsigned int>& users, unsigned int batchSize, const function<vector< vector<string> >(const vector<unsigned int>&)>& query,
+		ThreadPool& pool, UserResults& results) {
+	results.assign(users.size(), make_pair(0, vector<string>()));
+	vector<double> latencies(users.size(), 0.0);
+
+	unsigned int batches = (users.size() + batchSize - 1) / batchSize;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	pool.parallelFor(batches, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int b = begin; b < end; b++) {
+			unsigned int first = b * batchSize;
+			unsigned int last = (first + batchSize < users.size()) ? first + batchSize : users.size();
+			vector<unsigned int> batch(users.begin() + first, users.begin() + last);
+
+			chrono::steady_clock::time_point queryStart = chrono::steady_clock::now();
+			vector< vector<string> > batchResults = query(batch);
+			double latency = chrono::duration<double, milli>(chrono::steady_clock::now() - queryStart).count();
+
+			for (unsigned int i = first; i < last; i++) {
+				results[i] = make_pair(users[i], batchResults[i - first]);
+				latencies[i] = latency;
+			}
+		}
+	});
+	double wallTime = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	sort(latencies.begin(), latencies.end());
+	cout << "[+] " << name << ": " << users.size() << " users in " << wallTime << " ms ("
+		<< ((wallTime > 0) ? users.size() / (wallTime / 1000) : 0.0) << " users/s, " << pool.size() << " threads)" << endl;
+	cout << "    Latency (ms): p50 " << percentile(latencies, 0.50) << " | p95 " << percentile(latencies, 0.95)
+		<< " | p99 " << percentile(latencies, 0.99) << " | max " << percentile(latencies, 1.0) << endl;
+	return wallTime;
+}
+
+
+
+/* Signal handler of the server mode */
+void stopServer(int) {
+	if (server != NULL) {
+		server->stop();
+	}
+}
+
+
+
+/* Nearest-rank percentile of sorted values */
+double percentile(const vector<double>& sorted, double fraction) {
+	if (sorted.size() == 0) {
+		return 0.0;
+	}
+	// The smallest value with at least the given fraction of the values up to it
+	unsigned int rank = (unsigned int) ceil(fraction * sorted.size());
+	if (rank > 0) {
+		rank--;
+	}
+	return sorted[(rank < sorted.size()) ? rank : sorted.size() - 1];
 }
@@ -0,0 +1,63 @@
+#include <cmath>
+#include "matrix.h"
+
+// Number of rows of A and B processed together so that both tiles stay in cache
+static const unsigned int ROW_TILE = 16;
+static const unsigned int COL_TILE = 64;
+
+/* Compute C = A * B^T where A is n x d, B is m x d and C is n x m (all row-major).
+ * Every dot product is accumulated in the same order as DataPoint::dotProduct
+ * so that the results match the ones computed one point at a time */
+void multiplyTransposed(const double *A, unsigned int n, const double *B, unsigned int m, unsigned int d, double *C) {
+	for (unsigned int i0 = 0; i0 < n; i0 += ROW_TILE) {
+		unsigned int iEnd = (i0 + ROW_TILE < n) ? i0 + ROW_TILE : n;
+		for (unsigned int j0 = 0; j0 < m; j0 += COL_TILE) {
+			unsigned int jEnd = (j0 + COL_TILE < m) ? j0 + COL_TILE : m;
+
+			// Multiply the tile of A with the tile of B
+			for (unsigned int i = i0; i < iEnd; i++) {
+				const double *a = A + (unsigned long long) i * d;
+				double *c = C + (unsigned long long) i * m;
+				for (unsigned int j = j0; j < jEnd; j++) {
+					const double *b = B + (unsigned long long) j * d;
+					double total = 0.0;
+					for (unsigned int t = 0; t < d; t++) {
+						total += a[t] * b[t];
+					}
+					c[j] = total;
+				}
+			}
+		}
+	}
+}
+
+
+/* In-place unnormalized Walsh-Hadamard transform of a vector whose size is a power of 2 */
+void fastWalshHadamard(double *x, unsigned int n) {
+	for (unsigned int half = 1; half < n; half *= 2) {
+		for (unsigned int i = 0; i < n; i += 2 * half) {
+			for (unsigned int j = i; j < i + half; j++) {
+				double a = x[j];
+				double b = x[j + half];
+				x[j] = a + b;
+				x[j + half] = a - b;
+			}
+		}
+	}
+}
+
+
+/* Divide a vector by its norm (zero vectors don't change) */
+void normalizeRow(double *x, unsigned int d) {
+	double norm = 0.0;
+	for (unsigned int t = 0; t < d; t++) {
+		norm += x[t] * x[t];
+	}
+	norm = sqrt(norm);
+	if (norm == 0) {
+		return;
+	}
+	for (unsigned int t = 0; t < d; t++) {
+		x[t] /= norm;
+	}
+}
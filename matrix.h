@@ -0,0 +1,9 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+// Row-major dense matrix helpers used by the batched neighbor searches
+void multiplyTransposed(const double *, unsigned int, const double *, unsigned int, unsigned int, double *);
+void fastWalshHadamard(double *, unsigned int);
+void normalizeRow(double *, unsigned int);
+
+#endif // MATRIX_H
@@ -0,0 +1,25 @@
+#include <vector>
+#include "neighbor_search.h"
+#include "data_point.h"
+
+/* Insert the points one by one
+ * (Indexes that can be built in parallel override this) */
+void NeighborSearch::insertAll(std::vector<DataPoint>& points) {
+	for (unsigned int i = 0; i < points.size(); i++) {
+		insert(points[i]);
+	}
+}
+
+
+/* Answer every query of the batch separately
+ * (Indexes that can share work between the queries override this) */
+void NeighborSearch::findNearestNeighborsBatch(const std::vector<const DataPoint *>& queries, unsigned int K, std::vector< std::vector<DataPoint *> >& results, std::vector< std::vector<double> >& distances) const {
+	results.clear();
+	distances.clear();
+	results.resize(queries.size());
+	distances.resize(queries.size());
+
+	for (unsigned int i = 0; i < queries.size(); i++) {
+		findNearestNeighbors(*queries[i], K, results[i], distances[i]);
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef NEIGHBOR_SEARCH_H
+#define NEIGHBOR_SEARCH_H
+
+#include <vector>
+#include "data_point.h"
+
+/* Index used by the recommenders to find the nearest neighbors (cosine distance) of a user */
+class NeighborSearch {
+protected:
+	// The element of a copy of a vector at the position of an element of the vector
+	static DataPoint *movePoint(const DataPoint *p, const std::vector<DataPoint>& from, std::vector<DataPoint>& to) {
+		return &to[0] + (p - &from[0]);
+	}
+public:
+	static const int LSH_SEARCH = 1;
+	static const int EXACT_SEARCH = 2;
+	static const int HNSW_SEARCH = 3;
+
+	virtual void insert(DataPoint&) = 0;
+	virtual void insertAll(std::vector<DataPoint>&);
+	// The coordinates of an inserted point changed: refresh its entry
+	virtual void update(DataPoint&) = 0;
+	// Return up to K nearest points sorted by increasing distance
+	virtual void findNearestNeighbors(const DataPoint&, unsigned int, std::vector<DataPoint *>&, std::vector<double>&) const = 0;
+	virtual void findNearestNeighborsBatch(const std::vector<const DataPoint *>&, unsigned int, std::vector< std::vector<DataPoint *> >&, std::vector< std::vector<double> >&) const;
+
+	virtual unsigned long long getSize() const = 0;
+	// Copy of the index of the points of a vector that indexes the same elements of a copy of the
+	// vector instead (so that the copy can be updated while the index is queried)
+	virtual NeighborSearch *copy(const std::vector<DataPoint>&, std::vector<DataPoint>&) const = 0;
+
+	virtual ~NeighborSearch() {}
+};
+
+#endif // NEIGHBOR_SEARCH_H
@@ -0,0 +1,88 @@
+#include <vector>
+#include <set>
+#include <utility> // std::pair, std::make_pair
+#include <cmath> // std::abs
+#include "prediction.h"
+#include "data_point.h"
+
+/* Subtract the average of every point from its ratings once */
+void RatingMatrix::build(const std::vector<DataPoint>& points, const std::vector<double>& pointsAverage) {
+	first = (points.size() > 0) ? &points[0] : NULL;
+	rows = points.size();
+	columns = (points.size() > 0) ? points[0].getDimensions() : 0;
+	averages = pointsAverage;
+
+	centered.resize((unsigned long long) rows * columns);
+	for (unsigned int i = 0; i < rows; i++) {
+		double *row = &centered[(unsigned long long) i * columns];
+		for (unsigned int j = 0; j < columns; j++) {
+			row[j] = points[i].at(j) - averages[i];
+		}
+	}
+}
+
+
+
+/* Refresh the rows of the given points (the points after the last row are added).
+ * Returns false if the points aren't the elements of the vector given to build any more */
+bool RatingMatrix::update(const std::vector<DataPoint>& points, const std::vector<double>& pointsAverage, const std::vector<unsigned int>& changed) {
+	if (rows == 0 || points.size() < rows || &points[0] != first) {
+		return false;
+	}
+
+	rows = points.size();
+	averages.resize(rows);
+	centered.resize((unsigned long long) rows * columns);
+	for (unsigned int k = 0; k < changed.size(); k++) {
+		unsigned int i = changed[k];
+		averages[i] = pointsAverage[i];
+		double *row = &centered[(unsigned long long) i * columns];
+		for (unsigned int j = 0; j < columns; j++) {
+			row[j] = points[i].at(j) - averages[i];
+		}
+	}
+	return true;
+}
+
+
+
+/* The weights (similarities of the neighbors) are computed once by the caller. Every
+ * neighbor row is added to the sums of all the coins with its weight (contiguous, so
+ * the loop vectorizes) and then the sums of the unknown coins are gathered.
+ * Returns (predicted rating, coin) in the order of the coins */
+std::vector< std::pair<double, unsigned int> > RatingMatrix::predict(double average, const std::vector<unsigned int>& neighborRows,
+		const std::vector<double>& weights, const std::set<unsigned int>& unknown) const {
+	std::vector< std::pair<double, unsigned int> > predictions;
+	if (neighborRows.size() == 0 || unknown.size() == 0) {
+		return predictions;
+	}
+
+	// Normalizing factor z
+	double z_sum = 0.0;
+	for (unsigned int k = 0; k < weights.size(); k++) {
+		z_sum += std::abs(weights[k]);
+	}
+	double z;
+	if (z_sum != 0) {
+		z = 1 / z_sum;
+	} else { // Similarity with every neighbor is 0
+		z = 1;
+	}
+
+	std::vector<double> sums(columns, 0.0);
+	for (unsigned int k = 0; k < neighborRows.size(); k++) {
+		const double *row = &centered[(unsigned long long) neighborRows[k] * columns];
+		double weight = weights[k];
+		for (unsigned int j = 0; j < columns; j++) {
+			sums[j] += weight * row[j];
+		}
+	}
+
+	predictions.reserve(unknown.size());
+	for (std::set<unsigned int>::const_iterator it = unknown.begin(); it != unknown.end(); it++) {
+		if (*it < columns) {
+			predictions.push_back(std::make_pair(average + z * sums[*it], *it));
+		}
+	}
+	return predictions;
+}
@@ -0,0 +1,38 @@
+#ifndef PREDICTION_H
+#define PREDICTION_H
+
+#include <vector>
+#include <set>
+#include <utility> // std::pair
+#include "data_point.h"
+
+/* Mean-centered ratings (r_ij - average_i) of the points given to build, stored in one
+ * contiguous row-major matrix. The points must stay in place while the matrix is used,
+ * since the row of a point is found from its address instead of its ID */
+class RatingMatrix {
+private:
+	const DataPoint *first;
+	unsigned int rows;
+	unsigned int columns;
+	std::vector<double> centered;
+	std::vector<double> averages;
+public:
+	RatingMatrix() : first(NULL), rows(0), columns(0) {}
+
+	void build(const std::vector<DataPoint>&, const std::vector<double>&);
+	bool update(const std::vector<DataPoint>&, const std::vector<double>&, const std::vector<unsigned int>&);
+	// The points were copied to another vector (a copy of the matrix for the copied points)
+	void moveTo(const std::vector<DataPoint>& points) { first = (points.size() > 0) ? &points[0] : NULL; }
+
+	// Row of a point of the matrix (-1 if the point wasn't given to build)
+	int row(const DataPoint *p) const {
+		return (rows > 0 && p >= first && p < first + rows) ? p - first : -1;
+	}
+	double average(unsigned int r) const { return averages[r]; }
+
+	// Predict the unknown ratings of a user from the rows of his neighbors:
+	// average + z * sum(w_k * centered_kj) with z = 1 / sum(|w_k|)
+	std::vector< std::pair<double, unsigned int> > predict(double, const std::vector<unsigned int>&, const std::vector<double>&, const std::set<unsigned int>&) const;
+};
+
+#endif // PREDICTION_H
@@ -11,121 +11,384 @@
 #include "recommendation.h"
 #include "tweet.h"
 #include "clustering.h"
+#include "streaming_kmeans.h"
 #include "cosine_lsh_recommender.h"
 #include "clustering_recommender.h"
 #include "data_point.h"
 #include "metrics.h"
 
-const char *Recommendation::PROCESSED_TWEETS_FILENAME = "datasets/twitter_dataset_small_v2.csv";
-
-Recommendation::Recommendation(const std::vector<Tweet>& tweets, unsigned int neighbors, int usersNumClusters, int virtualNumClusters) : kMeans(NULL) {
+Recommendation::Recommendation(const std::vector<Tweet>& tweets, unsigned int neighbors, int usersNumClusters, int virtualNumClusters, int searchMethodArg, const std::string& graphPrefix,
+		int aggregation, double period, const RecommendationParameters& parametersArg)
+		: numberOfNeighbors(neighbors), userClusters(usersNumClusters), virtualUserClusters(virtualNumClusters), searchMethod(searchMethodArg), parameters(parametersArg),
+		  userAggregator(aggregation, period), clusterAggregator(aggregation, period), numberOfTweetClusters(0), kMeans(NULL) {
 	std::cout << "[*] Creating sentiment scores based on users" << std::endl;
 	createUserSentiments(tweets);
 	std::cout << "[*] Creating sentiment scores based on clusters" << std::endl;
 	createClusterSentiments(tweets);
+	refreshSentiments();
 
-	rec1 = new CosineLSHRecommender(neighbors);
-	rec1->train(userSentiments, usersAverageSentiment, clusterSentiments, clustersAverageSentiment);
-	rec2 = new ClusteringRecommender(usersNumClusters, virtualNumClusters, neighbors);
-	rec2->train(userSentiments, usersAverageSentiment, clusterSentiments, clustersAverageSentiment);
+	std::atomic_store(&model, std::shared_ptr<const RecommendationModel>(buildModel(graphPrefix)));
 }
 
 
 
-/* Create a total sentiment for every user based on his tweets */
-void Recommendation::createUserSentiments(const std::vector<Tweet>& tweets) {
-	// Create a vector for every user as the sum of the sentiments of each one of his/her tweets
-	std::vector<double> userSentiment(tweets[0].getSentiment().size());
-	std::fill(userSentiment.begin(), userSentiment.end(), Tweet::SENTIMENT_NOT_SET);
+/* Set the parameters of the indexes of a Cosine LSH recommender before training it */
+void Recommendation::configure(CosineLSHRecommender& recommender) const {
+	recommender.setHNSWParameters(parameters.hnswM, parameters.hnswEfConstruction, parameters.hnswEfSearch);
+	recommender.setSignatureFilter(parameters.signatureBits, parameters.rerankSize);
+	recommender.setStructuredProjections(parameters.structuredProjections);
+}
 
-	// NOTE: User IDs must be grouped
-	unsigned int currUser = tweets[0].getUser();
-	for (unsigned int i = 0; i < tweets.size(); i++) {
-		std::vector<double> sentiment = tweets[i].getSentiment();
-		if (tweets[i].getUser() == currUser) {
-			for (unsigned int j = 0; j < sentiment.size(); j++) {
-				if (sentiment[j] != Tweet::SENTIMENT_NOT_SET) {
-					if (userSentiment[j] != Tweet::SENTIMENT_NOT_SET) {
-						userSentiment[j] += sentiment[j];
-					} else {
-						userSentiment[j] = sentiment[j];
-					}
-				}
-			}
-		} else { // New user: save current user sentiment and reset it
-			// Calculate average sentiment of the user
-			double sum = 0.0;
-			unsigned int knownCount = 0;
-			bool nonZero = false;
-			for (unsigned int j = 0; j < userSentiment.size(); j++) {
-				if (userSentiment[j] != Tweet::SENTIMENT_NOT_SET) {
-					if (userSentiment[j] != 0) {
-						nonZero = true;
-					}
-					knownCount++;
-					sum += userSentiment[j];
-				}
-			}
 
-			if (knownCount > 0 && nonZero) { // Keep only users with at least one sentiments for a coin
-				usersAverageSentiment.push_back(sum / knownCount);
 
-				// Set the coins with unknown rating to the user's average
-				for (unsigned int j = 0; j < userSentiment.size(); j++) {
-					if (userSentiment[j] == Tweet::SENTIMENT_NOT_SET) {
-						unknownCoins[currUser].insert(j);
-						userSentiment[j] = sum / knownCount;
-					}
-				}
+/* Set the clustering of the users of a Clustering recommender before training it */
+void Recommendation::configure(ClusteringRecommender& recommender) const {
+	recommender.setInitialization(parameters.userInitialization);
+	recommender.setBoundedAssignment(parameters.boundedAssignment);
+	recommender.setBisecting(parameters.bisecting);
+}
 
-				DataPoint userPoint(userSentiment, std::to_string(currUser));
-				userSentiments.push_back(userPoint);
-				userToSentiment[currUser] = userSentiments.size() - 1;
-			}
 
-			currUser = tweets[i].getUser();
-			for (unsigned int j = 0; j < sentiment.size(); j++) {
-				userSentiment[j] = sentiment[j];
-			}
-		}
+
+/* Train new recommenders on a copy of the training data. The HNSW graphs
+ * are saved to (or loaded from) files with the given prefix if it's not empty */
+std::shared_ptr<RecommendationModel> Recommendation::buildModel(const std::string& graphPrefix) {
+	std::shared_ptr<RecommendationModel> newModel = std::make_shared<RecommendationModel>();
+	{
+		std::lock_guard<std::mutex> lock(trainingMutex);
+		newModel->userSentiments = userSentiments;
+		newModel->usersAverageSentiment = usersAverageSentiment;
+		newModel->clusterSentiments = clusterSentiments;
+		newModel->clustersAverageSentiment = clustersAverageSentiment;
+		newModel->userToSentiment = userToSentiment;
+		newModel->unknownCoins = unknownCoins;
+	}
+	// Room for the users added by addTweets (the indexes point to the elements)
+	newModel->userSentiments.reserve(newModel->userSentiments.size() + std::max(newModel->userSentiments.size() / 4, (size_t) MIN_NEW_USERS));
+
+	newModel->rec1 = new CosineLSHRecommender(numberOfNeighbors, 4, 5, searchMethod);
+	configure(*newModel->rec1);
+	newModel->rec1->setGraphPrefix(graphPrefix);
+	newModel->rec1->train(newModel->userSentiments, newModel->usersAverageSentiment, newModel->clusterSentiments, newModel->clustersAverageSentiment);
+	newModel->rec2 = new ClusteringRecommender(userClusters, virtualUserClusters, numberOfNeighbors);
+	configure(*newModel->rec2);
+	newModel->rec2->train(newModel->userSentiments, newModel->usersAverageSentiment, newModel->clusterSentiments, newModel->clustersAverageSentiment);
+	return newModel;
+}
+
+
+
+/* Copy a model with room for new users. The copies of the recommenders use the copies of
+ * the vectors, so the copy can be updated while the queries read the model */
+std::shared_ptr<RecommendationModel> Recommendation::copyModel(const RecommendationModel& source) const {
+	std::shared_ptr<RecommendationModel> newModel = std::make_shared<RecommendationModel>();
+	newModel->userSentiments.reserve(source.userSentiments.size() + std::max(source.userSentiments.size() / 4, (size_t) MIN_NEW_USERS));
+	newModel->userSentiments.assign(source.userSentiments.begin(), source.userSentiments.end());
+	newModel->usersAverageSentiment = source.usersAverageSentiment;
+	newModel->clusterSentiments = source.clusterSentiments;
+	newModel->clustersAverageSentiment = source.clustersAverageSentiment;
+	newModel->userToSentiment = source.userToSentiment;
+	newModel->unknownCoins = source.unknownCoins;
+
+	newModel->rec1 = source.rec1->copy(source.userSentiments, newModel->userSentiments, source.clusterSentiments, newModel->clusterSentiments);
+	newModel->rec2 = source.rec2->copy(newModel->userSentiments);
+	return newModel;
+}
+
+
+
+/* The queries keep using the current model until the new one replaces it */
+void Recommendation::retrain() {
+	std::lock_guard<std::mutex> lock(retrainMutex);
+	bool timeBased = (userAggregator.getMethod() != SentimentAggregator::SUM_AGGREGATION);
+	if (timeBased) {
+		refreshSentiments();
+		// Every user changed, so the replaced model can't be updated
+		standby.reset();
+	}
+
+	// The saved HNSW graphs belong to the first model, so they aren't used
+	std::shared_ptr<const RecommendationModel> previous = std::atomic_load(&model);
+	std::atomic_store(&model, std::shared_ptr<const RecommendationModel>(buildModel("")));
+	// The replaced model has every added tweet too, so it can be the standby one
+	if (standby != NULL) {
+		standby = std::const_pointer_cast<RecommendationModel>(previous);
+		standbyChanged.clear();
+	}
+}
+
+
+
+bool Recommendation::startRetraining() {
+	if (retraining.valid() && retraining.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		return false;
 	}
+	retraining = std::async(std::launch::async, [this]() { retrain(); });
+	return true;
+}
 
-	// Save last user's total sentiment
+
+
+/* Create the ratings of a user (or cluster) from his total sentiment: the coins with unknown
+ * rating are set to the average of the known ones. Returns false if there is no non zero rating */
+static bool userRatings(const std::vector<double>& total, std::vector<double>& ratings, double& average, std::set<unsigned int>& unknown) {
 	// Calculate average sentiment of the user
 	double sum = 0.0;
 	unsigned int knownCount = 0;
 	bool nonZero = false;
-	for (unsigned int j = 0; j < userSentiment.size(); j++) {
-		if (userSentiment[j] != Tweet::SENTIMENT_NOT_SET) {
-			if (userSentiment[j] != 0) {
+	for (unsigned int j = 0; j < total.size(); j++) {
+		if (total[j] != Tweet::SENTIMENT_NOT_SET) {
+			if (total[j] != 0) {
 				nonZero = true;
 			}
 			knownCount++;
-			sum += userSentiment[j];
+			sum += total[j];
+		}
+	}
+	if (knownCount == 0 || !nonZero) {
+		return false;
+	}
+
+	average = sum / knownCount;
+	ratings = total;
+	unknown.clear();
+	for (unsigned int j = 0; j < ratings.size(); j++) {
+		if (ratings[j] == Tweet::SENTIMENT_NOT_SET) {
+			unknown.insert(j);
+			ratings[j] = average;
+		}
+	}
+	return true;
+}
+
+
+
+/* Add the sentiment of every tweet to the total of its user
+ * (the users are kept in the order of their first tweet) */
+void Recommendation::createUserSentiments(const std::vector<Tweet>& tweets) {
+	std::set<unsigned int> changed;
+	for (unsigned int i = 0; i < tweets.size(); i++) {
+		if (!userAggregator.contains(tweets[i].getUser())) {
+			userOrder.push_back(tweets[i].getUser());
+		}
+		userAggregator.add(tweets[i].getUser(), tweets[i].getSentiment(), tweets[i].getTime(), changed);
+	}
+}
+
+
+
+/* Create the user and cluster sentiments from the totals at the time of the newest tweet.
+ * If no user (or no cluster) has tweets left in the window the previous sentiments are kept,
+ * since the recommenders can't be trained without points */
+void Recommendation::refreshSentiments() {
+	std::lock_guard<std::mutex> lock(trainingMutex);
+	double now = userAggregator.getNewest();
+	if (clusterAggregator.getNewest() > now) {
+		now = clusterAggregator.getNewest();
+	}
+	std::set<unsigned int> changed;
+	userAggregator.advance(now, changed);
+	clusterAggregator.advance(now, changed);
+	userAggregator.rebase(now);
+	clusterAggregator.rebase(now);
+
+	std::vector<DataPoint> newUserSentiments;
+	std::vector<double> newUsersAverageSentiment;
+	std::unordered_map<unsigned int, unsigned int> newUserToSentiment;
+	std::unordered_map<unsigned int, std::set<unsigned int> > newUnknownCoins;
+	for (unsigned int i = 0; i < userOrder.size(); i++) {
+		std::vector<double> total;
+		std::vector<double> ratings;
+		double average;
+		std::set<unsigned int> unknown;
+		// Keep only users with at least one sentiments for a coin
+		if (userAggregator.total(userOrder[i], total) && userRatings(total, ratings, average, unknown)) {
+			newUsersAverageSentiment.push_back(average);
+			newUserSentiments.push_back(DataPoint(ratings, std::to_string(userOrder[i])));
+			newUserToSentiment[userOrder[i]] = newUserSentiments.size() - 1;
+			newUnknownCoins[userOrder[i]] = unknown;
+		}
+	}
+	if (!newUserSentiments.empty()) {
+		userSentiments.swap(newUserSentiments);
+		usersAverageSentiment.swap(newUsersAverageSentiment);
+		userToSentiment.swap(newUserToSentiment);
+		unknownCoins.swap(newUnknownCoins);
+	}
+
+	std::vector<DataPoint> newClusterSentiments;
+	std::vector<double> newClustersAverageSentiment;
+	for (unsigned int i = 0; i < numberOfTweetClusters; i++) {
+		std::vector<double> total;
+		std::vector<double> ratings;
+		double average;
+		std::set<unsigned int> unknown;
+		if (clusterAggregator.total(i, total) && userRatings(total, ratings, average, unknown)) {
+			newClustersAverageSentiment.push_back(average);
+			newClusterSentiments.push_back(DataPoint(ratings, "C-" + std::to_string(i+1)));
+		}
+	}
+	if (!newClusterSentiments.empty()) {
+		clusterSentiments.swap(newClusterSentiments);
+		clustersAverageSentiment.swap(newClustersAverageSentiment);
+	}
+}
+
+
+
+/* Add new tweets (in any order of users): only the total sentiments of their users are
+ * updated and the models refresh only the index entries and the ratings of these users.
+ * The update goes to the standby model, or to a copy of the current one while queries
+ * still read the standby model. Returns the number of users whose ratings changed */
+unsigned int Recommendation::addTweets(const std::vector<Tweet>& tweets) {
+	std::vector<unsigned int> changed; // Indices of the user sentiments
+	bool rebased = false;
+	{
+		std::lock_guard<std::mutex> lock(trainingMutex);
+		// Users of the tweets and users whose tweets left the window
+		std::set<unsigned int> users;
+		for (unsigned int i = 0; i < tweets.size(); i++) {
+			if (!userAggregator.contains(tweets[i].getUser())) {
+				userOrder.push_back(tweets[i].getUser());
+			}
+			if (!userAggregator.add(tweets[i].getUser(), tweets[i].getSentiment(), tweets[i].getTime(), users)) {
+				rebased = true;
+			}
+		}
+
+		for (std::set<unsigned int>::const_iterator it = users.begin(); it != users.end() && !rebased; it++) {
+			std::vector<double> total;
+			std::vector<double> ratings;
+			double average;
+			std::set<unsigned int> unknown;
+			// A known user whose ratings cancel out (or who has no tweets left in the
+			// window) keeps his previous ratings until the next retraining
+			if (!userAggregator.total(*it, total) || !userRatings(total, ratings, average, unknown)) {
+				continue;
+			}
+
+			std::unordered_map<unsigned int, unsigned int>::const_iterator found = userToSentiment.find(*it);
+			if (found != userToSentiment.end()) {
+				userSentiments[found->second] = DataPoint(ratings, std::to_string(*it));
+				usersAverageSentiment[found->second] = average;
+				changed.push_back(found->second);
+			} else { // New user
+				userSentiments.push_back(DataPoint(ratings, std::to_string(*it)));
+				usersAverageSentiment.push_back(average);
+				userToSentiment[*it] = userSentiments.size() - 1;
+				changed.push_back(userSentiments.size() - 1);
+			}
+			unknownCoins[*it] = unknown;
+		}
+	}
+	if (rebased) { // Every decayed total was scaled, so everything is created again
+		retrain();
+		std::lock_guard<std::mutex> lock(trainingMutex);
+		return userSentiments.size();
+	}
+	if (changed.size() == 0) {
+		return 0;
+	}
+	std::sort(changed.begin(), changed.end());
+
+	std::lock_guard<std::mutex> lock(retrainMutex);
+	// Only changed by the holder of the retrain mutex
+	std::shared_ptr<const RecommendationModel> current = std::atomic_load(&model);
+	std::shared_ptr<RecommendationModel> next;
+	standbyChanged.insert(changed.begin(), changed.end());
+	if (standby != NULL && !hasReaders(*standby)) {
+		std::vector<unsigned int> users(standbyChanged.begin(), standbyChanged.end());
+		if (updateModel(*standby, users)) {
+			next = standby;
 		}
 	}
+	if (next == NULL) { // First update, no room for the new users or queries still read the standby model
+		next = copyModel(*current);
+		if (!updateModel(*next, changed)) {
+			next = buildModel("");
+		}
+	}
+
+	// The replaced model becomes the standby one. It has every tweet except the new ones
+	standby = std::const_pointer_cast<RecommendationModel>(current);
+	standbyChanged.clear();
+	standbyChanged.insert(changed.begin(), changed.end());
+	std::atomic_store(&model, std::shared_ptr<const RecommendationModel>(next));
+	return changed.size();
+}
 
-	if (knownCount > 0 && nonZero) {
-		usersAverageSentiment.push_back(sum / knownCount);
 
-		// Set the coins with unknown rating to the user's average
-		for (unsigned int j = 0; j < userSentiment.size(); j++) {
-			if (userSentiment[j] == Tweet::SENTIMENT_NOT_SET) {
-				unknownCoins[tweets[tweets.size()-1].getUser()].insert(j);
-				userSentiment[j] = sum / knownCount;
+
+/* Copy the given users (and every user added after the last one of the model) from the
+ * training data to a model that isn't used by any query and refresh only their entries.
+ * Returns false if the vectors of the model have no room for the new users */
+bool Recommendation::updateModel(RecommendationModel& target, const std::vector<unsigned int>& changed) {
+	std::vector<unsigned int> users;
+	{
+		std::lock_guard<std::mutex> lock(trainingMutex);
+		if (userSentiments.size() > target.userSentiments.capacity()) {
+			return false;
+		}
+
+		unsigned int first = target.userSentiments.size();
+		for (unsigned int k = 0; k < changed.size() && changed[k] < first; k++) {
+			users.push_back(changed[k]);
+		}
+		for (unsigned int i = first; i < userSentiments.size(); i++) {
+			users.push_back(i);
+		}
+
+		for (unsigned int k = 0; k < users.size(); k++) {
+			unsigned int i = users[k];
+			if (i < first) {
+				target.userSentiments[i] = userSentiments[i];
+				target.usersAverageSentiment[i] = usersAverageSentiment[i];
+			} else {
+				target.userSentiments.push_back(userSentiments[i]);
+				target.usersAverageSentiment.push_back(usersAverageSentiment[i]);
 			}
+			unsigned int userID = std::stoul(userSentiments[i].getID());
+			target.userToSentiment[userID] = i;
+			target.unknownCoins[userID] = unknownCoins[userID];
+		}
+	}
+
+	return target.rec1->update(target.userSentiments, target.usersAverageSentiment, users)
+		&& target.rec2->update(target.userSentiments, target.usersAverageSentiment, users);
+}
+
+
+
+/* The model used by the queries right now. The returned pointer (and every copy of it)
+ * counts as a reader of the model until it's released */
+std::shared_ptr<const RecommendationModel> Recommendation::getModel() const {
+	while (true) {
+		std::shared_ptr<const RecommendationModel> current = std::atomic_load(&model);
+		current->readers++;
+		// The model may have been replaced before it got the reader, so it may be updated.
+		// If it wasn't, the writer that replaces it sees the reader (both are sequentially consistent)
+		if (std::atomic_load(&model) == current) {
+			return std::shared_ptr<const RecommendationModel>(current.get(), [current](const RecommendationModel *) {
+				current->readers--;
+			});
 		}
 
-		DataPoint userPoint(userSentiment, std::to_string(tweets[tweets.size()-1].getUser()));
-		userSentiments.push_back(userPoint);
-		userToSentiment[tweets[tweets.size()-1].getUser()] = userSentiments.size() - 1;
+		current->readers--;
 	}
 }
 
 
 
-/* Place all processed tweets into clusters using K-means and create a total
- * sentiment for each cluster */
+/* Check if a query still reads a model. A model that isn't published gets no new readers
+ * (a query that loaded it before it was replaced gives it up without reading it) */
+bool Recommendation::hasReaders(const RecommendationModel& target) const {
+	return target.readers.load() > 0;
+}
+
+
+
+/* Place all processed tweets into clusters using K-means and add the sentiment
+ * of every tweet to the total of its cluster */
 void Recommendation::createClusterSentiments(const std::vector<Tweet>& tweets) {
 	// Map tweet IDs to index to find them faster when we know their ID
 	std::unordered_map<std::string, unsigned int> IDToIndex;
@@ -138,69 +401,63 @@ void Recommendation::createClusterSentiments(const std::vector<Tweet>& tweets) {
 	}
 
 
-	// Get the processed tweets
-	if (readProcessedTweets(PROCESSED_TWEETS_FILENAME, processedTweets, existingIDs) == false) {
-		std::cerr << "[-] Error while reading processed tweets file: " << PROCESSED_TWEETS_FILENAME << std::endl;
-		exit(-1);
-	}
-
-	// Perform clustering of the tweets using K-means
-	kMeans = new KMeansClustering(processedTweets, NUMBER_OF_CLUSTERS, Metrics::COSINE);
-	kMeans->run();
-
 	// Get the point IDs of each cluster
 	std::vector< std::vector<std::string> > clusters;
-	kMeans->getPointsPerCluster(clusters);
-
 
-	// Create a vector for every cluster as the sum of the sentiments of its tweets
-	std::vector<double> clusterSentiment(tweets[0].getSentiment().size());
-	// Create total sentiment for every cluster
-	for (unsigned int i = 0; i < clusters.size(); i++) { // Each cluster
-		std::fill(clusterSentiment.begin(), clusterSentiment.end(), Tweet::SENTIMENT_NOT_SET);
-		for (unsigned int j = 0; j < clusters[i].size(); j++) { // Each point in cluster
-			unsigned int tweetIndex = IDToIndex[clusters[i][j]];
-			std::vector<double> sentiment = tweets[tweetIndex].getSentiment();
-
-			for (unsigned int k = 0; k < sentiment.size(); k++) { // Each coin sentiment
-				if (sentiment[k] != Tweet::SENTIMENT_NOT_SET) {
-					if (clusterSentiment[k] != Tweet::SENTIMENT_NOT_SET) {
-						clusterSentiment[k] += sentiment[k];
-					} else {
-						clusterSentiment[k] = sentiment[k];
-					}
+	const char *processedTweetsFile = parameters.processedTweetsFile.c_str();
+	std::ifstream processedFile(processedTweetsFile, std::ios::binary | std::ios::ate);
+	if (processedFile && (unsigned long long) processedFile.tellg() > parameters.streamingFileSize) {
+		// Too large to load: cluster the tweets reading the file in chunks
+		processedFile.close();
+		StreamingKMeans streamingKMeans(processedTweetsFile, parameters.tweetClusters, Metrics::COSINE, parameters.streamingChunkSize);
+		if (streamingKMeans.run() < 0) {
+			std::cerr << "[-] Error while reading processed tweets file: " << processedTweetsFile << std::endl;
+			exit(-1);
+		}
+		streamingKMeans.getPointsPerCluster(clusters);
+
+		// Check if the processed tweet IDs match the given tweets
+		for (unsigned int i = 0; i < clusters.size(); i++) {
+			for (unsigned int j = 0; j < clusters[i].size(); j++) {
+				if (IDToIndex.find(clusters[i][j]) == IDToIndex.end()) {
+					std::cerr << "[-] Unknown processed tweet ID: " << clusters[i][j] << std::endl;
+					exit(-1);
 				}
 			}
 		}
+	} else {
+		processedFile.close();
 
-		// Calculate average sentiment of the cluster
-		double sum = 0.0;
-		unsigned int knownCount = 0;
-		bool nonZero = false;
-		for (unsigned int k = 0; k < clusterSentiment.size(); k++) {
-			if (clusterSentiment[k] != Tweet::SENTIMENT_NOT_SET) {
-				if (clusterSentiment[k] != 0) {
-					nonZero = true;
-				}
-				knownCount++;
-				sum += clusterSentiment[k];
-			}
+		// Get the processed tweets
+		if (readProcessedTweets(processedTweetsFile, processedTweets, existingIDs) == false) {
+			std::cerr << "[-] Error while reading processed tweets file: " << processedTweetsFile << std::endl;
+			exit(-1);
 		}
 
-		if (knownCount > 0 && nonZero) {
-			clustersAverageSentiment.push_back(sum / knownCount);
+		// Perform clustering of the tweets using K-means
+		if (parameters.tweetClusters >= parameters.lshAssignmentClusters) {
+			kMeans = new LSHSphericalKMeans(processedTweets, parameters.tweetClusters, LSH_ASSIGNMENT_HASH_FUNCTIONS, LSH_ASSIGNMENT_TABLES);
+		} else {
+			kMeans = new SphericalKMeans(processedTweets, parameters.tweetClusters);
+		}
+		kMeans->setInitialization(KMeansClustering::KMEANS_PARALLEL_INIT);
+		if (processedTweets.size() > MINI_BATCH_THRESHOLD) {
+			kMeans->setMiniBatch(MINI_BATCH_SIZE);
+		}
+		kMeans->run();
+		kMeans->getPointsPerCluster(clusters);
+	}
 
-			// Set the coins with unknown rating to the user's average
-			for (unsigned int j = 0; j < clusterSentiment.size(); j++) {
-				if (clusterSentiment[j] == Tweet::SENTIMENT_NOT_SET) {
-					clusterSentiment[j] = sum / knownCount;
-				}
-			}
 
-			DataPoint clusterPoint(clusterSentiment, "C-" + std::to_string(i+1));
-			clusterSentiments.push_back(clusterPoint);
+	// Add the sentiment of every tweet to the total of its cluster
+	std::set<unsigned int> changed;
+	for (unsigned int i = 0; i < clusters.size(); i++) { // Each cluster
+		for (unsigned int j = 0; j < clusters[i].size(); j++) { // Each point in cluster
+			const Tweet& tweet = tweets[IDToIndex[clusters[i][j]]];
+			clusterAggregator.add(i, tweet.getSentiment(), tweet.getTime(), changed);
 		}
 	}
+	numberOfTweetClusters = clusters.size();
 }
 
 
@@ -262,12 +519,13 @@ bool Recommendation::readProcessedTweets(const char *filename, std::vector<DataP
 
 /* Combine user based and cluster based recommendations */
 std::vector<std::string> Recommendation::cosineLSHRecommendations(unsigned int userID, const std::vector< std::vector<std::string> >& coins) const {
-	if (userToSentiment.find(userID) == userToSentiment.end()) {
+	std::shared_ptr<const RecommendationModel> current = getModel();
+	if (current->userToSentiment.find(userID) == current->userToSentiment.end()) {
 		std::vector<std::string> empty;
 		return empty;
 	}
-	unsigned int userIndex = userToSentiment.at(userID);
-	std::vector<unsigned int> result = rec1->recommendations(userSentiments[userIndex], unknownCoins.at(userID));
+	unsigned int userIndex = current->userToSentiment.at(userID);
+	std::vector<unsigned int> result = current->rec1->recommendations(current->userSentiments[userIndex], current->unknownCoins.at(userID));
 
 	std::vector<std::string> recommendedCoins;
 	for (unsigned int i = 0; i < result.size(); i++) {
@@ -278,14 +536,44 @@ std::vector<std::string> Recommendation::cosineLSHRecommendations(unsigned int u
 
 
 
+/* Cosine LSH recommendations for a batch of users (sharing the hashing of the users) */
+std::vector< std::vector<std::string> > Recommendation::cosineLSHRecommendations(const std::vector<unsigned int>& userIDs, const std::vector< std::vector<std::string> >& coins) const {
+	std::vector< std::vector<std::string> > recommendedCoins(userIDs.size());
+	std::shared_ptr<const RecommendationModel> current = getModel();
+
+	// Get the sentiment vector and the unrated coins of every known user
+	std::vector<const DataPoint *> users;
+	std::vector<const std::set<unsigned int> *> unknown;
+	std::vector<unsigned int> indices;
+	for (unsigned int i = 0; i < userIDs.size(); i++) {
+		if (current->userToSentiment.find(userIDs[i]) == current->userToSentiment.end()) {
+			continue;
+		}
+		users.push_back(&current->userSentiments[current->userToSentiment.at(userIDs[i])]);
+		unknown.push_back(&current->unknownCoins.at(userIDs[i]));
+		indices.push_back(i);
+	}
+
+	std::vector< std::vector<unsigned int> > results = current->rec1->recommendations(users, unknown);
+	for (unsigned int i = 0; i < results.size(); i++) {
+		for (unsigned int j = 0; j < results[i].size(); j++) {
+			recommendedCoins[indices[i]].push_back(coins[results[i][j]][0]);
+		}
+	}
+	return recommendedCoins;
+}
+
+
+
 /* Combine user based and cluster based recommendations */
 std::vector<std::string> Recommendation::clusteringRecommendations(unsigned int userID, const std::vector< std::vector<std::string> >& coins) const {
-	if (userToSentiment.find(userID) == userToSentiment.end()) {
+	std::shared_ptr<const RecommendationModel> current = getModel();
+	if (current->userToSentiment.find(userID) == current->userToSentiment.end()) {
 		std::vector<std::string> empty;
 		return empty;
 	}
-	unsigned int userIndex = userToSentiment.at(userID);
-	std::vector<unsigned int> result = rec2->recommendations(userSentiments[userIndex], unknownCoins.at(userID));
+	unsigned int userIndex = current->userToSentiment.at(userID);
+	std::vector<unsigned int> result = current->rec2->recommendations(current->userSentiments[userIndex], current->unknownCoins.at(userID));
 
 	std::vector<std::string> recommendedCoins;
 	for (unsigned int i = 0; i < result.size(); i++) {
@@ -296,10 +584,24 @@ std::vector<std::string> Recommendation::clusteringRecommendations(unsigned int
 
 
 
-/* Validate methods A and B using Cosine LSH and Clustering recommendation systems */
+/* Find the number of clusters with the best silhouette for the real and the virtual users */
+std::vector<int> Recommendation::findBestClusters(const std::vector<int>& options, unsigned int silhouetteSample) {
+	std::lock_guard<std::mutex> lock(trainingMutex);
+	return getModel()->rec2->findBestClusters(options, userSentiments, clusterSentiments, silhouetteSample);
+}
+
+
+
+/* Validate methods A and B using Cosine LSH and Clustering recommendation systems.
+ * The validation trains its own recommenders, so the model of the queries isn't changed */
 std::vector< std::pair<double, double> > Recommendation::validate() {
-	std::vector<double> methodAResults = validateMethodA();
-	std::vector<double> methodBResults = validateMethodB();
+	std::lock_guard<std::mutex> lock(trainingMutex);
+	CosineLSHRecommender lshRecommender(numberOfNeighbors, 4, 5, searchMethod);
+	configure(lshRecommender);
+	ClusteringRecommender clusteringRecommender(userClusters, virtualUserClusters, numberOfNeighbors);
+	configure(clusteringRecommender);
+	std::vector<double> methodAResults = validateMethodA(lshRecommender, clusteringRecommender);
+	std::vector<double> methodBResults = validateMethodB(lshRecommender, clusteringRecommender);
 
 	// Get the error for each recommendation system and each method
 	std::vector< std::pair<double, double> > result(2);
@@ -313,7 +615,7 @@ std::vector< std::pair<double, double> > Recommendation::validate() {
 
 
 /* 10-fold cross validation for user based predictions for each recommendation system */
-std::vector<double> Recommendation::validateMethodA() {
+std::vector<double> Recommendation::validateMethodA(CosineLSHRecommender& lshRecommender, ClusteringRecommender& clusteringRecommender) {
 	std::cout << "\n[*] Method A validation:" << std::endl;
 
 	// Total error for each recommendation system
@@ -418,15 +720,15 @@ std::vector<double> Recommendation::validateMethodA() {
 		}
 
 		// Retrain the recommendation systems with the new data
-		rec1->train(userSentiments, usersAverageSentiment, clusterSentiments, clustersAverageSentiment);
-		rec2->train(userSentiments, usersAverageSentiment, clusterSentiments, clustersAverageSentiment);
+		lshRecommender.train(userSentiments, usersAverageSentiment, clusterSentiments, clustersAverageSentiment);
+		clusteringRecommender.train(userSentiments, usersAverageSentiment, clusterSentiments, clustersAverageSentiment);
 
 		// Get the ratings for the unknown coins
 		for (unsigned int i = 0; i < userSentiments.size(); i++) {
 			unsigned int userID = atoi(userSentiments[i].getID().c_str());
 			if (validationCoins.find(userID) != validationCoins.end() && validationCoins.at(userID).size() > 0) { // User has at least one unrated coin
-				std::vector< std::pair<double, unsigned int> > LSHResults = rec1->userBasedPredictions(userSentiments[i], validationCoins[userID]);
-				std::vector< std::pair<double, unsigned int> > clusterResults = rec2->userBasedPredictions(userSentiments[i], validationCoins[userID]);
+				std::vector< std::pair<double, unsigned int> > LSHResults = lshRecommender.userBasedPredictions(userSentiments[i], validationCoins[userID]);
+				std::vector< std::pair<double, unsigned int> > clusterResults = clusteringRecommender.userBasedPredictions(userSentiments[i], validationCoins[userID]);
 				// Cosine LSH recommendation error
 				for (unsigned int j = 0; j < LSHResults.size(); j++) {
 					unsigned int coin = LSHResults[j].second;
@@ -477,7 +779,7 @@ std::vector<double> Recommendation::validateMethodA() {
 
 
 /* Validation for cluster based predictions for each recommendation system */
-std::vector<double> Recommendation::validateMethodB() {
+std::vector<double> Recommendation::validateMethodB(CosineLSHRecommender& lshRecommender, ClusteringRecommender& clusteringRecommender) {
 	std::cout << "\n[*] Method B validation:" << std::endl;
 
 	// Total error for each recommendation system
@@ -581,15 +883,15 @@ std::vector<double> Recommendation::validateMethodB() {
 		}
 
 		// Retrain the recommendation systems with the new data
-		rec1->train(userSentiments, usersAverageSentiment, clusterSentiments, clustersAverageSentiment);
-		rec2->train(userSentiments, usersAverageSentiment, clusterSentiments, clustersAverageSentiment);
+		lshRecommender.train(userSentiments, usersAverageSentiment, clusterSentiments, clustersAverageSentiment);
+		clusteringRecommender.train(userSentiments, usersAverageSentiment, clusterSentiments, clustersAverageSentiment);
 
 		// Get the ratings for the unknown coins
 		for (unsigned int i = 0; i < userSentiments.size(); i++) {
 			unsigned int userID = atoi(userSentiments[i].getID().c_str());
 			if (validationCoins.find(userID) != validationCoins.end() && validationCoins.at(userID).size() > 0) { // User has at least one unrated coin
-				std::vector< std::pair<double, unsigned int> > LSHResults = rec1->clusterBasedPredictions(userSentiments[i], validationCoins[userID]);
-				std::vector< std::pair<double, unsigned int> > clusterResults = rec2->clusterBasedPredictions(userSentiments[i], validationCoins[userID]);
+				std::vector< std::pair<double, unsigned int> > LSHResults = lshRecommender.clusterBasedPredictions(userSentiments[i], validationCoins[userID]);
+				std::vector< std::pair<double, unsigned int> > clusterResults = clusteringRecommender.clusterBasedPredictions(userSentiments[i], validationCoins[userID]);
 				// Cosine LSH recommendation error
 				for (unsigned int j = 0; j < LSHResults.size(); j++) {
 					unsigned int coin = LSHResults[j].second;
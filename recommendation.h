@@ -6,16 +6,108 @@
 #include <unordered_map>
 #include <set>
 #include <utility> // std::pair
+#include <memory> // std::shared_ptr
+#include <mutex>
+#include <atomic>
+#include <future>
 #include "tweet.h"
 #include "clustering.h"
 #include "cosine_lsh_recommender.h"
+#include "neighbor_search.h"
 #include "clustering_recommender.h"
 #include "data_point.h"
+#include "sentiment_aggregator.h"
+#include "streaming_kmeans.h"
+
+/* Everything the queries read. Built from a copy of the training data and never
+ * changed after it is published, so queries can use it while a new one is built.
+ * The recommenders point to the vectors of the model, so it is only copied together with
+ * them (Recommendation::copyModel) */
+struct RecommendationModel {
+	std::vector<DataPoint> userSentiments;
+	std::vector<double> usersAverageSentiment;
+	std::vector<DataPoint> clusterSentiments;
+	std::vector<double> clustersAverageSentiment;
+	std::unordered_map<unsigned int, unsigned int> userToSentiment;
+	std::unordered_map<unsigned int, std::set<unsigned int> > unknownCoins;
+
+	CosineLSHRecommender *rec1;
+	ClusteringRecommender *rec2;
+
+	// Queries reading the model (Recommendation::getModel). A model that isn't
+	// published is only updated when it has no readers
+	mutable std::atomic<unsigned int> readers;
+
+	RecommendationModel() : rec1(NULL), rec2(NULL), readers(0) {}
+	RecommendationModel(const RecommendationModel&) = delete;
+	RecommendationModel& operator=(const RecommendationModel&) = delete;
+
+	~RecommendationModel() {
+		if (rec1 != NULL) {
+			delete rec1;
+		}
+		if (rec2 != NULL) {
+			delete rec2;
+		}
+	}
+};
+
+/* Parameters of the indexes of the recommenders (the defaults are used if not changed) */
+struct RecommendationParameters {
+	// TF-IDF and SVD vectors of the tweets (clustered for the virtual users)
+	std::string processedTweetsFile;
+	// HNSW index
+	unsigned int hnswM;
+	unsigned int hnswEfConstruction;
+	unsigned int hnswEfSearch;
+	// Hamming distance filter of the LSH: signature bits and candidates kept (disabled if 0 bits)
+	unsigned int signatureBits;
+	unsigned int rerankSize;
+	bool structuredProjections; // Hash the LSH with Hadamard transforms instead of r_i vectors
+	// Cluster the processed tweets without loading them if the file is larger (bytes)
+	// reading this many points at a time
+	unsigned long long streamingFileSize;
+	unsigned int streamingChunkSize;
+	// Clusters of the processed tweets, assigned to the centroids with LSH for at least lshAssignmentClusters
+	unsigned int tweetClusters;
+	unsigned int lshAssignmentClusters;
+	// Clustering of the users: initialization, Hamerly's bounds and bisecting K-means
+	int userInitialization;
+	bool boundedAssignment;
+	bool bisecting;
+
+	RecommendationParameters() : processedTweetsFile("datasets/twitter_dataset_small_v2.csv"), hnswM(16), hnswEfConstruction(200), hnswEfSearch(50), signatureBits(0), rerankSize(0), structuredProjections(false),
+		streamingFileSize(1ULL << 30), streamingChunkSize(StreamingKMeans::DEFAULT_CHUNK_SIZE), tweetClusters(100), lshAssignmentClusters(1000),
+		userInitialization(KMeansClustering::RANDOM_INIT), boundedAssignment(false), bisecting(false) {}
+};
 
 class Recommendation {
 private:
-	static const char *PROCESSED_TWEETS_FILENAME;
-	static const unsigned int NUMBER_OF_CLUSTERS = 100;
+	// Use mini-batch K-means for more processed tweets than this
+	static const unsigned int MINI_BATCH_THRESHOLD = 100000;
+	static const unsigned int MINI_BATCH_SIZE = 2048;
+	// LSH of the centroids used to assign the processed tweets
+	static const int LSH_ASSIGNMENT_HASH_FUNCTIONS = 10;
+	static const int LSH_ASSIGNMENT_TABLES = 5;
+	// Users that can be added to a model (at least a quarter of its users) before it's built again
+	static const unsigned int MIN_NEW_USERS = 1024;
+
+	// Parameters of the recommenders
+	unsigned int numberOfNeighbors;
+	int userClusters;
+	int virtualUserClusters;
+	int searchMethod;
+	RecommendationParameters parameters;
+
+	// Training data (only changed while holding the training mutex)
+	std::mutex trainingMutex;
+
+	// Total sentiments of the tweets of every user and every cluster of tweets
+	// (sums, decayed sums or sums over a window of time)
+	SentimentAggregator userAggregator;
+	SentimentAggregator clusterAggregator;
+	std::vector<unsigned int> userOrder; // Users in the order of their first tweet
+	unsigned int numberOfTweetClusters;
 
 	// Total sentiments for each user
 	std::vector<DataPoint> userSentiments;
@@ -32,35 +124,68 @@ private:
 	// Unrated coins for each user
 	std::unordered_map<unsigned int, std::set<unsigned int> > unknownCoins;
 
-	CosineLSHRecommender *rec1;
-	ClusteringRecommender *rec2;
+	// Model used by the queries. Replaced atomically (std::atomic_load/atomic_store):
+	// a query keeps the model it loaded alive until it finishes
+	std::shared_ptr<const RecommendationModel> model;
+	// One retraining at a time, so the models are published in order
+	std::mutex retrainMutex;
+	std::future<void> retraining; // Background retraining
+	// The model replaced by the last update, which gets the next update if no query reads
+	// it any more and then replaces the current one (only kept after tweets are added).
+	// standbyChanged are the users it doesn't have yet (indices of the user sentiments)
+	std::shared_ptr<RecommendationModel> standby;
+	std::set<unsigned int> standbyChanged;
 
+	void configure(CosineLSHRecommender&) const;
+	void configure(ClusteringRecommender&) const;
+	std::shared_ptr<RecommendationModel> buildModel(const std::string&);
+	std::shared_ptr<RecommendationModel> copyModel(const RecommendationModel&) const;
+	bool updateModel(RecommendationModel&, const std::vector<unsigned int>&);
+	bool hasReaders(const RecommendationModel&) const;
 	void createUserSentiments(const std::vector<Tweet>&);
 	void createClusterSentiments(const std::vector<Tweet>&);
+	void refreshSentiments();
 	bool readProcessedTweets(const char *, std::vector<DataPoint>&, std::set<std::string>&) const;
 
-	std::vector<double> validateMethodA();
-	std::vector<double> validateMethodB();
+	std::vector<double> validateMethodA(CosineLSHRecommender&, ClusteringRecommender&);
+	std::vector<double> validateMethodB(CosineLSHRecommender&, ClusteringRecommender&);
 public:
-	Recommendation(const std::vector<Tweet>&, unsigned int, int, int);
+	// The tweets of every user and cluster are summed, or aggregated with a half-life or a
+	// window (period) using the times of the tweets
+	Recommendation(const std::vector<Tweet>&, unsigned int, int, int, int searchMethod = NeighborSearch::LSH_SEARCH, const std::string& graphPrefix = "",
+		int aggregation = SentimentAggregator::SUM_AGGREGATION, double period = 0.0, const RecommendationParameters& parametersArg = RecommendationParameters());
 
 	std::vector<std::string> cosineLSHRecommendations(unsigned int, const std::vector< std::vector<std::string> >&) const;
+	std::vector< std::vector<std::string> > cosineLSHRecommendations(const std::vector<unsigned int>&, const std::vector< std::vector<std::string> >&) const;
 	std::vector<std::string> clusteringRecommendations(unsigned int, const std::vector< std::vector<std::string> >&) const;
 
-	std::vector<int> findBestClusters(const std::vector<int>& options) { return rec2->findBestClusters(options, userSentiments, clusterSentiments); }
+	// Exact silhouette if the sample size is 0
+	std::vector<int> findBestClusters(const std::vector<int>&, unsigned int silhouetteSample = 0);
+
+	// Add new scored tweets updating only the users they belong to
+	unsigned int addTweets(const std::vector<Tweet>&);
 
 	std::vector< std::pair<double, double> > validate();
 
+	// Aggregation of the sentiments of the tweets (the tweets need times if it's not the sum)
+	int getAggregation() const { return userAggregator.getMethod(); }
+	// The model used by the queries right now (a reader of it until the pointer is released)
+	std::shared_ptr<const RecommendationModel> getModel() const;
+	// Build a new model from the training data and replace the current one when it's ready.
+	// With a time-based aggregation the user and cluster sentiments are created again at the
+	// time of the newest tweet first (the cluster sentiments change only here). If every tweet
+	// of the users (or of the clusters) left the window, their previous sentiments are kept
+	void retrain();
+	// Retrain in a background thread. Returns false if a retraining is still running
+	bool startRetraining();
+
 	virtual ~Recommendation() {
+		if (retraining.valid()) {
+			retraining.wait();
+		}
 		if (kMeans != NULL) {
 			delete kMeans;
 		}
-		if (rec1 != NULL) {
-			delete rec1;
-		}
-		if (rec2 != NULL) {
-			delete rec2;
-		}
 	}
 };
 
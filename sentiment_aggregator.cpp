@@ -0,0 +1,153 @@
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <utility> // std::pair, std::make_pair
+#include <cmath> // std::exp2
+#include <cstdlib> // exit
+#include "sentiment_aggregator.h"
+#include "tweet.h"
+
+
+SentimentAggregator::SentimentAggregator(int methodArg, double periodArg)
+		: method(methodArg), period(periodArg), started(false), reference(0.0), newest(0.0) {
+	if (method != SUM_AGGREGATION && method != DECAYED_AGGREGATION && method != WINDOW_AGGREGATION) {
+		std::cerr << "Invalid sentiment aggregation: " << method << std::endl;
+		exit(-1);
+	}
+	if (method != SUM_AGGREGATION && period <= 0) {
+		std::cerr << "Invalid half-life or window: " << period << std::endl;
+		exit(-1);
+	}
+}
+
+
+
+bool SentimentAggregator::add(unsigned int key, const std::vector<double>& sentiment, double time, std::set<unsigned int>& changed) {
+	if (!started) {
+		started = true;
+		reference = time;
+		newest = time;
+	}
+	if (method == WINDOW_AGGREGATION && time <= newest - period) { // Already out of the window
+		totals[key]; // The key is known (without tweets)
+		return true;
+	}
+	if (time > newest) {
+		newest = time;
+	}
+
+	bool rebased = false;
+	if (method == DECAYED_AGGREGATION && (time - reference) / period > MAX_HALF_LIVES) {
+		rebase(newest);
+		rebased = true;
+	}
+	double weight = (method == DECAYED_AGGREGATION) ? std::exp2((time - reference) / period) : 1.0;
+
+	Total& keyTotal = totals[key];
+	if (keyTotal.sums.size() < sentiment.size()) {
+		keyTotal.sums.resize(sentiment.size(), 0.0);
+		keyTotal.counts.resize(sentiment.size(), 0);
+	}
+
+	WindowTweet tweet;
+	tweet.time = time;
+	tweet.key = key;
+	for (unsigned int j = 0; j < sentiment.size(); j++) {
+		if (sentiment[j] != Tweet::SENTIMENT_NOT_SET) {
+			keyTotal.sums[j] += weight * sentiment[j];
+			keyTotal.counts[j]++;
+			if (method == WINDOW_AGGREGATION) {
+				tweet.sentiment.push_back(std::make_pair(j, sentiment[j]));
+			}
+		}
+	}
+	changed.insert(key);
+
+	if (method == WINDOW_AGGREGATION) {
+		if (window.empty() || time >= window.back().time) {
+			window.push_back(tweet);
+		} else {
+			lateTweets.push(tweet);
+		}
+		expire(changed);
+	}
+	return !rebased;
+}
+
+
+
+void SentimentAggregator::advance(double time, std::set<unsigned int>& changed) {
+	if (time > newest) {
+		newest = time;
+	}
+	if (method == WINDOW_AGGREGATION) {
+		expire(changed);
+	}
+}
+
+
+
+/* Subtract the tweets that are older than the window from the totals */
+void SentimentAggregator::expire(std::set<unsigned int>& changed) {
+	while (!window.empty() && window.front().time <= newest - period) {
+		remove(window.front());
+		changed.insert(window.front().key);
+		window.pop_front();
+	}
+	while (!lateTweets.empty() && lateTweets.top().time <= newest - period) {
+		remove(lateTweets.top());
+		changed.insert(lateTweets.top().key);
+		lateTweets.pop();
+	}
+}
+
+
+
+/* A coin without tweets in the window is set to 0 exactly (no rounding errors left) */
+void SentimentAggregator::remove(const WindowTweet& tweet) {
+	Total& keyTotal = totals[tweet.key];
+	for (unsigned int k = 0; k < tweet.sentiment.size(); k++) {
+		unsigned int j = tweet.sentiment[k].first;
+		keyTotal.counts[j]--;
+		if (keyTotal.counts[j] == 0) {
+			keyTotal.sums[j] = 0.0;
+		} else {
+			keyTotal.sums[j] -= tweet.sentiment[k].second;
+		}
+	}
+}
+
+
+
+void SentimentAggregator::rebase(double time) {
+	if (method != DECAYED_AGGREGATION || !started || time == reference) {
+		return;
+	}
+
+	double factor = std::exp2((reference - time) / period);
+	for (std::unordered_map<unsigned int, Total>::iterator it = totals.begin(); it != totals.end(); it++) {
+		for (unsigned int j = 0; j < it->second.sums.size(); j++) {
+			it->second.sums[j] *= factor;
+		}
+	}
+	reference = time;
+}
+
+
+
+bool SentimentAggregator::total(unsigned int key, std::vector<double>& result) const {
+	std::unordered_map<unsigned int, Total>::const_iterator found = totals.find(key);
+	if (found == totals.end()) {
+		return false;
+	}
+
+	result = found->second.sums;
+	for (unsigned int j = 0; j < result.size(); j++) {
+		if (found->second.counts[j] == 0) {
+			result[j] = Tweet::SENTIMENT_NOT_SET;
+		}
+	}
+	return true;
+}
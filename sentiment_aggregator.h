@@ -0,0 +1,80 @@
+#ifndef SENTIMENT_AGGREGATOR_H
+#define SENTIMENT_AGGREGATOR_H
+
+#include <vector>
+#include <deque>
+#include <queue>
+#include <set>
+#include <unordered_map>
+#include <utility> // std::pair
+
+/* Total sentiment for every coin of the tweets of a key (user or cluster), kept up to date
+ * as tweets arrive with O(number of coins) work per tweet:
+ *   Sum: every tweet has weight 1
+ *   Decayed: a tweet of age a has weight 2^(-a / half-life). The tweets are added with weight
+ *     2^((t - reference) / half-life), so the totals are the decayed totals at the reference
+ *     time and the old totals never have to be scaled, apart from moving the reference
+ *   Window: only the tweets of the last period count. The tweets are kept in time order and
+ *     the ones that leave the window are subtracted (once per tweet). Tweets that arrive
+ *     after newer ones are kept in a heap instead: O(log n) for them */
+class SentimentAggregator {
+public:
+	static const int SUM_AGGREGATION = 1;
+	static const int DECAYED_AGGREGATION = 2;
+	static const int WINDOW_AGGREGATION = 3;
+private:
+	// Largest number of half-lives between a tweet and the reference time before
+	// every total is scaled to a new reference time (keeps the weights finite)
+	static const int MAX_HALF_LIVES = 64;
+
+	struct Total {
+		std::vector<double> sums;
+		std::vector<unsigned int> counts; // Tweets with a sentiment for every coin
+	};
+
+	// Tweet of the window: its key and its (coin, sentiment) pairs
+	struct WindowTweet {
+		double time;
+		unsigned int key;
+		std::vector< std::pair<unsigned int, double> > sentiment;
+
+		// Order of the heap (oldest on top)
+		bool operator<(const WindowTweet& other) const { return time > other.time; }
+	};
+
+	int method;
+	double period; // Half-life or window length
+	bool started; // Any tweet added
+	double reference; // Time of the decayed totals
+	double newest; // Latest tweet time
+
+	std::unordered_map<unsigned int, Total> totals;
+	std::deque<WindowTweet> window; // In time order
+	std::priority_queue<WindowTweet> lateTweets; // Older than the last tweet of the window when added
+
+
+	void remove(const WindowTweet&);
+	void expire(std::set<unsigned int>&);
+public:
+	SentimentAggregator(int methodArg = SUM_AGGREGATION, double periodArg = 0.0);
+
+	// Add the sentiment of a tweet to the total of the key. The keys whose totals changed
+	// (the key and the keys of the tweets that left the window) are inserted in changed.
+	// Returns false if every total was scaled to a new reference time
+	bool add(unsigned int, const std::vector<double>&, double, std::set<unsigned int>&);
+	// Move the time forward without adding a tweet (drops the tweets out of the window)
+	void advance(double, std::set<unsigned int>&);
+	// Scale the decayed totals to the given reference time
+	void rebase(double);
+
+	// Sums of the coins of the key with Tweet::SENTIMENT_NOT_SET for coins without tweets.
+	// Returns false for a key without tweets
+	bool total(unsigned int, std::vector<double>&) const;
+	// True if any tweet of the key was added
+	bool contains(unsigned int key) const { return totals.find(key) != totals.end(); }
+
+	int getMethod() const { return method; }
+	double getNewest() const { return newest; }
+};
+
+#endif // SENTIMENT_AGGREGATOR_H
@@ -0,0 +1,373 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm> // std::all_of
+#include <cstring> // strncpy, strerror
+#include <cstdlib> // strtoul
+#include <cerrno>
+#include <cctype> // isdigit
+#include <future>
+#include <chrono>
+#include <utility> // std::move
+#include <unistd.h> // close, unlink
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "recommendation.h"
+#include "thread_pool.h"
+#include "tweet.h"
+#include "file_io.h"
+#include "sentiment_aggregator.h"
+
+RecommendationServer::RecommendationServer(Recommendation& recommendationArg, const std::vector< std::vector<std::string> >& coinsArg,
+		const std::unordered_map<std::string, double>& sentimentMapArg, double alphaArg, const std::string& path, unsigned int threadsArg)
+		: recommendation(recommendationArg), coins(coinsArg), sentimentMap(sentimentMapArg), alpha(alphaArg), socketPath(path), threads(threadsArg), stopping(false) {}
+
+
+
+bool RecommendationServer::run() {
+	struct sockaddr_un address;
+	if (socketPath.size() >= sizeof(address.sun_path)) {
+		std::cerr << "[-] Socket path is too long: " << socketPath << std::endl;
+		return false;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+	int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0) {
+		std::cerr << "[-] Couldn't create the socket: " << strerror(errno) << std::endl;
+		return false;
+	}
+	// Remove the socket of a previous run
+	unlink(socketPath.c_str());
+	if (bind(listenFd, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(listenFd, SOMAXCONN) < 0
+			|| fcntl(listenFd, F_SETFL, O_NONBLOCK) < 0) {
+		std::cerr << "[-] Couldn't listen on " << socketPath << ": " << strerror(errno) << std::endl;
+		close(listenFd);
+		return false;
+	}
+
+	ThreadPool pool(threads);
+	std::cout << "[+] Serving on " << socketPath << " (" << pool.size() << " workers)" << std::endl;
+
+	std::vector<Connection> connections;
+	std::vector<struct pollfd> pollFds;
+	std::vector<Request> requests;
+	while (!stopping) {
+		// The listening socket first, then every connection. A connection waiting for
+		// an added file isn't read (and is ignored if it has nothing to send)
+		pollFds.resize(connections.size() + 1);
+		pollFds[0].fd = listenFd;
+		pollFds[0].events = POLLIN;
+		bool adding = false;
+		for (unsigned int c = 0; c < connections.size(); c++) {
+			bool waiting = connections[c].adding.valid();
+			bool reading = !connections[c].closing && !connections[c].hungUp && !waiting;
+			adding = adding || waiting;
+			pollFds[c + 1].fd = (waiting && connections[c].output.empty()) ? -1 : connections[c].fd;
+			pollFds[c + 1].events = (reading ? POLLIN : 0) | (connections[c].output.empty() ? 0 : POLLOUT);
+			pollFds[c + 1].revents = 0;
+		}
+		pollFds[0].revents = 0;
+
+		if (poll(&pollFds[0], pollFds.size(), adding ? ADD_POLL_TIMEOUT : POLL_TIMEOUT) < 0) {
+			if (errno == EINTR) { // Interrupted by a signal (maybe stop)
+				continue;
+			}
+			std::cerr << "[-] Poll failed: " << strerror(errno) << std::endl;
+			break;
+		}
+
+		// Read the requests of every client (and the ones after the files that have been added)
+		requests.clear();
+		for (unsigned int c = 0; c < connections.size(); c++) {
+			Connection& connection = connections[c];
+			if (connection.adding.valid() && connection.adding.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+				connection.output += connection.adding.get();
+				parseRequests(connection, c, requests);
+			}
+			if (pollFds[c + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+				if (!readRequests(connection, c, requests)) {
+					connection.hungUp = true;
+				}
+			}
+		}
+
+		// Answer them together and queue the responses
+		answerRequests(pool, requests);
+		for (unsigned int r = 0; r < requests.size(); r++) {
+			connections[requests[r].connection].output += requests[r].response;
+		}
+
+		// Send what the clients can receive and drop the finished connections
+		// (a connection is kept until its added file is added)
+		unsigned int kept = 0;
+		for (unsigned int c = 0; c < connections.size(); c++) {
+			if (!sendResponses(connections[c])) {
+				connections[c].output.clear();
+				connections[c].closing = true;
+			}
+			if ((connections[c].closing || connections[c].hungUp) && connections[c].output.empty() && !connections[c].adding.valid()) {
+				close(connections[c].fd);
+				continue;
+			}
+			if (kept != c) {
+				connections[kept] = std::move(connections[c]);
+			}
+			kept++;
+		}
+		connections.resize(kept);
+
+		// Accept the new clients
+		if (pollFds[0].revents & POLLIN) {
+			int fd;
+			while ((fd = accept(listenFd, NULL, NULL)) >= 0) {
+				if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+					close(fd);
+					continue;
+				}
+				Connection connection;
+				connection.fd = fd;
+				connection.closing = false;
+				connection.hungUp = false;
+				connections.push_back(std::move(connection));
+			}
+		}
+	}
+
+	// Destroying the connections waits for the files they're adding
+	for (unsigned int c = 0; c < connections.size(); c++) {
+		close(connections[c].fd);
+	}
+	close(listenFd);
+	unlink(socketPath.c_str());
+	return true;
+}
+
+
+
+/* Read everything the client has sent and parse its complete lines.
+ * Returns false if the client closed the connection (its requests are still answered) */
+bool RecommendationServer::readRequests(Connection& connection, unsigned int index, std::vector<Request>& requests) {
+	char buffer[4096];
+	bool open = true;
+	while (true) {
+		ssize_t bytes = recv(connection.fd, buffer, sizeof(buffer), 0);
+		if (bytes > 0) {
+			connection.input.append(buffer, bytes);
+			continue;
+		}
+		if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+		open = false; // Closed by the client or error
+		break;
+	}
+
+	parseRequests(connection, index, requests);
+	return open;
+}
+
+
+
+/* Parse the complete lines received (until quit or shutdown, or until a file is being
+ * added: the next lines are parsed after it's added) */
+void RecommendationServer::parseRequests(Connection& connection, unsigned int index, std::vector<Request>& requests) {
+	std::string::size_type start = 0;
+	std::string::size_type end;
+	while (!connection.closing && !connection.adding.valid() && (end = connection.input.find('\n', start)) != std::string::npos) {
+		std::string line = connection.input.substr(start, end - start);
+		start = end + 1;
+
+		Request request;
+		request.connection = index;
+		if (parseRequest(line, request, connection)) {
+			requests.push_back(request);
+		}
+	}
+	connection.input.erase(0, start);
+
+	if (connection.closing) {
+		connection.input.clear();
+	} else if (!connection.adding.valid() && connection.input.size() > MAX_LINE_LENGTH) {
+		Request request;
+		request.connection = index;
+		request.method = 0;
+		request.response = "ERROR Request too long\n";
+		requests.push_back(request);
+		connection.closing = true;
+	}
+}
+
+
+
+/* Parse a request line. Requests answered immediately (errors) keep their response.
+ * Returns false for lines without a response (or answered later: added files) */
+bool RecommendationServer::parseRequest(const std::string& line, Request& request, Connection& connection) {
+	std::istringstream lineStream(line);
+	std::string command;
+	if (!(lineStream >> command)) { // Empty line
+		return false;
+	}
+
+	request.method = 0;
+	if (command == "quit") {
+		connection.closing = true;
+		return false;
+	} else if (command == "shutdown") {
+		connection.closing = true;
+		stopping = true;
+		request.response = "OK\n";
+		return true;
+	} else if (command == "retrain") {
+		if (recommendation.startRetraining()) {
+			request.response = "OK\n";
+		} else {
+			request.response = "ERROR Retraining already running\n";
+		}
+		return true;
+	} else if (command == "add") {
+		std::string filename;
+		if (!(lineStream >> filename)) {
+			request.response = "ERROR No tweets file\n";
+			return true;
+		}
+		connection.adding = std::async(std::launch::async, &RecommendationServer::addTweets, this, filename);
+		return false;
+	} else if (command == "lsh") {
+		request.method = LSH_REQUEST;
+	} else if (command == "clustering") {
+		request.method = CLUSTERING_REQUEST;
+	} else {
+		request.response = "ERROR Unknown command: " + command + "\n";
+		return true;
+	}
+
+	std::string token;
+	while (lineStream >> token) {
+		if (!std::all_of(token.begin(), token.end(), isdigit) || token.size() > 9) {
+			request.method = 0;
+			request.users.clear();
+			request.response = "ERROR Invalid user ID: " + token + "\n";
+			return true;
+		}
+		request.users.push_back(strtoul(token.c_str(), NULL, 10));
+	}
+	if (request.users.size() == 0) {
+		request.method = 0;
+		request.response = "ERROR No user ID\n";
+	}
+	return true;
+}
+
+
+
+/* Score the tweets of a file and add them to the model (the queries keep using the
+ * current model until the updated one replaces it). Runs in the background and
+ * returns the response */
+std::string RecommendationServer::addTweets(const std::string& filename) {
+	std::vector<Tweet> tweets;
+	unsigned int neighbors = 0; // The P of the file is ignored
+	int res = readInputFile(filename.c_str(), tweets, neighbors, recommendation.getAggregation() != SentimentAggregator::SUM_AGGREGATION);
+	if (res == IO_GENERAL_ERROR) {
+		return "ERROR Can't read tweets file: " + filename + "\n";
+	} else if (res == IO_NOT_UNIQUE) {
+		return "ERROR Tweet IDs are not unique: " + filename + "\n";
+	} else if (res == IO_NOT_INCREASING) {
+		return "ERROR Tweet or user IDs are not in increasing order: " + filename + "\n";
+	}
+
+	for (unsigned int i = 0; i < tweets.size(); i++) {
+		tweets[i].calculateSentiments(sentimentMap, alpha, coins);
+	}
+	return "OK " + std::to_string(recommendation.addTweets(tweets)) + "\n";
+}
+
+
+
+/* Answer every request of the round on the pool: the Cosine LSH users of all the
+ * requests are queried in batches and the clustering users one at a time */
+void RecommendationServer::answerRequests(ThreadPool& pool, std::vector<Request>& requests) const {
+	// (request, user) pairs of every method
+	std::vector< std::pair<unsigned int, unsigned int> > lshQueries;
+	std::vector< std::pair<unsigned int, unsigned int> > clusteringQueries;
+	for (unsigned int r = 0; r < requests.size(); r++) {
+		requests[r].results.resize(requests[r].users.size());
+		for (unsigned int u = 0; u < requests[r].users.size(); u++) {
+			if (requests[r].method == LSH_REQUEST) {
+				lshQueries.push_back(std::make_pair(r, u));
+			} else if (requests[r].method == CLUSTERING_REQUEST) {
+				clusteringQueries.push_back(std::make_pair(r, u));
+			}
+		}
+	}
+
+	unsigned int batches = (lshQueries.size() + MAX_BATCH_SIZE - 1) / MAX_BATCH_SIZE;
+	pool.parallelFor(batches + clusteringQueries.size(), [&](unsigned int begin, unsigned int end) {
+		for (unsigned int t = begin; t < end; t++) {
+			if (t >= batches) {
+				const std::pair<unsigned int, unsigned int>& query = clusteringQueries[t - batches];
+				Request& request = requests[query.first];
+				request.results[query.second] = recommendation.clusteringRecommendations(request.users[query.second], coins);
+				continue;
+			}
+
+			unsigned int first = t * MAX_BATCH_SIZE;
+			unsigned int last = (first + MAX_BATCH_SIZE < lshQueries.size()) ? first + MAX_BATCH_SIZE : lshQueries.size();
+			std::vector<unsigned int> users;
+			for (unsigned int q = first; q < last; q++) {
+				users.push_back(requests[lshQueries[q].first].users[lshQueries[q].second]);
+			}
+			std::vector< std::vector<std::string> > results = recommendation.cosineLSHRecommendations(users, coins);
+			for (unsigned int q = first; q < last; q++) {
+				requests[lshQueries[q].first].results[lshQueries[q].second] = results[q - first];
+			}
+		}
+	});
+
+	// Same format as the output file
+	for (unsigned int r = 0; r < requests.size(); r++) {
+		Request& request = requests[r];
+		for (unsigned int u = 0; u < request.users.size(); u++) {
+			request.response += std::to_string(request.users[u]) + ": ";
+			if (request.results[u].size() == 0) {
+				request.response += "No results";
+			}
+			for (unsigned int j = 0; j < request.results[u].size(); j++) {
+				if (j > 0) {
+					request.response += "\t";
+				}
+				request.response += request.results[u][j];
+			}
+			request.response += "\n";
+		}
+	}
+}
+
+
+
+/* Send as much of the queued responses as the client can receive.
+ * Returns false if the connection failed */
+bool RecommendationServer::sendResponses(Connection& connection) const {
+	while (!connection.output.empty()) {
+		ssize_t bytes = send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+		if (bytes > 0) {
+			connection.output.erase(0, bytes);
+		} else if (bytes < 0 && errno == EINTR) {
+			continue;
+		} else if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return true;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,89 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <atomic>
+#include <future>
+#include "recommendation.h"
+
+class ThreadPool;
+
+/* Answers recommendation requests of local clients over a Unix domain socket using a
+ * trained model. Protocol (one request per line, '\n' terminated):
+ *   lsh <user ID> [<user ID> ...]         Cosine LSH recommendations
+ *   clustering <user ID> [<user ID> ...]  Clustering recommendations
+ *   retrain                               Retrain the model in the background
+ *   add <tweets file>                     Add the tweets of a file (format of the input file,
+ *                                         with the time column for the time-based aggregations)
+ *                                         updating only their users in the background
+ *                                         ("OK <changed users>" when they're added). The next
+ *                                         requests of the connection wait for it
+ *   quit                                  Close the connection
+ *   shutdown                              Stop the server
+ * Every user ID of a request gets one line in the order of the request, in the format
+ * of the output file ("<user ID>: <coin>\t<coin>..." or "<user ID>: No results").
+ * An invalid request gets a single "ERROR <reason>" line. The requests are answered with
+ * the current model until a retraining (or an added file) replaces it.
+ * One thread does the socket I/O. The requests that arrive together (from any client)
+ * are answered in one round on the worker pool and the Cosine LSH users of the round
+ * are queried in batches */
+class RecommendationServer {
+private:
+	// Users of a batched Cosine LSH query
+	static const unsigned int MAX_BATCH_SIZE = 32;
+	// Longest request line (the connection is closed after longer ones)
+	static const unsigned int MAX_LINE_LENGTH = 65536;
+	// Milliseconds between checks of the stop flag (and of the added files while they're added)
+	static const int POLL_TIMEOUT = 200;
+	static const int ADD_POLL_TIMEOUT = 10;
+
+	static const int LSH_REQUEST = 1;
+	static const int CLUSTERING_REQUEST = 2;
+
+	struct Connection {
+		int fd;
+		std::string input; // Received bytes of incomplete lines
+		std::string output; // Responses not sent yet
+		bool closing; // Close when the responses are sent
+		bool hungUp; // Closed by the client (the received requests are still answered)
+		std::future<std::string> adding; // Response of the file being added
+	};
+
+	struct Request {
+		unsigned int connection;
+		int method;
+		std::vector<unsigned int> users;
+		std::vector< std::vector<std::string> > results;
+		std::string response;
+	};
+
+	Recommendation& recommendation;
+	const std::vector< std::vector<std::string> >& coins;
+	// Used to score the added tweets
+	const std::unordered_map<std::string, double>& sentimentMap;
+	double alpha;
+	std::string socketPath;
+	unsigned int threads;
+	std::atomic<bool> stopping;
+
+
+	bool readRequests(Connection&, unsigned int, std::vector<Request>&);
+	void parseRequests(Connection&, unsigned int, std::vector<Request>&);
+	bool parseRequest(const std::string&, Request&, Connection&);
+	std::string addTweets(const std::string&);
+	void answerRequests(ThreadPool&, std::vector<Request>&) const;
+	bool sendResponses(Connection&) const;
+public:
+	// Use every hardware thread as a worker if threads is 0
+	RecommendationServer(Recommendation&, const std::vector< std::vector<std::string> >&, const std::unordered_map<std::string, double>&, double,
+		const std::string&, unsigned int threadsArg = 0);
+
+	// Serve until stop() or a shutdown request. Returns false if the socket can't be created
+	bool run();
+	// Can be called from another thread or a signal handler
+	void stop() { stopping = true; }
+};
+
+#endif // SERVER_H
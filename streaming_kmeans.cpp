@@ -0,0 +1,286 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm> // std::all_of
+#include <random>
+#include <chrono>
+#include "streaming_kmeans.h"
+#include "clustering.h"
+#include "data_point.h"
+#include "metrics.h"
+#include "matrix.h"
+#include "thread_pool.h"
+
+
+StreamingKMeans::StreamingKMeans(const std::string& file, int numClusters, int metric, unsigned int chunk)
+		: filename(file), numberOfClusters(numClusters), spherical(metric != Metrics::EUCLIDEAN), chunkSize(chunk),
+		  threads(0), tolerance(1e-10), dimensions(0), numberOfPoints(0) {
+	// Invalid arguments
+	if (numClusters <= 1 || chunk == 0) {
+		std::cerr << "Invalid number of clusters: " << numClusters << " or chunk size: " << chunk << std::endl;
+		exit(-1);
+	}
+
+	// Initialize the seed for the random number generator
+	unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count();
+	generator.seed(seed);
+}
+
+
+
+/* Read the next points of the file (no points at the end of the file) */
+bool StreamingKMeans::readChunk(std::ifstream& input, std::vector<DataPoint>& chunk) const {
+	chunk.clear();
+	std::string line;
+	while (chunk.size() < chunkSize && getline(input, line)) {
+		// Skip lines that are empty or contain only whitespaces
+		if (line == "" || std::all_of(line.begin(), line.end(), isspace)) {
+			continue;
+		}
+
+		DataPoint point;
+		if (point.readDataPoint(line) == false) {
+			return false;
+		}
+
+		// Dimensions of different points don't match
+		if ((dimensions != 0 && point.getDimensions() != dimensions)
+				|| (chunk.size() > 0 && point.getDimensions() != chunk[0].getDimensions())) {
+			return false;
+		}
+		chunk.push_back(point);
+	}
+
+	return true;
+}
+
+
+
+/* First pass: count the points and keep a uniform sample of them (reservoir sampling) */
+bool StreamingKMeans::sample(std::vector<DataPoint>& reservoir) {
+	std::ifstream input(filename.c_str());
+	if (!input) {
+		return false;
+	}
+
+	unsigned long sampleSize = (unsigned long) SAMPLE_FACTOR * numberOfClusters;
+
+	reservoir.clear();
+	numberOfPoints = 0;
+	std::vector<DataPoint> chunk;
+	while (true) {
+		if (readChunk(input, chunk) == false) {
+			return false;
+		}
+		if (chunk.size() == 0) { // End of file
+			break;
+		}
+		dimensions = chunk[0].getDimensions();
+
+		for (unsigned int i = 0; i < chunk.size(); i++) {
+			if (reservoir.size() < sampleSize) {
+				reservoir.push_back(chunk[i]);
+			} else {
+				// Replace a sampled point with probability sampleSize / (points so far)
+				std::uniform_int_distribution<unsigned long> uniform(0, numberOfPoints);
+				unsigned long index = uniform(generator);
+				if (index < sampleSize) {
+					reservoir[index] = chunk[i];
+				}
+			}
+			numberOfPoints++;
+		}
+	}
+
+	return true;
+}
+
+
+
+/* Find the closest centroid to a point */
+int StreamingKMeans::nearestCentroid(const DataPoint& point) const {
+	int best = 0;
+	double bestValue = 0.0;
+	for (int j = 0; j < numberOfClusters; j++) {
+		const double *centroid = &centroids[j * dimensions];
+		double value = 0.0;
+		if (spherical) { // Unit centroids: maximum dot product
+			for (unsigned int t = 0; t < dimensions; t++) {
+				value -= point.at(t) * centroid[t];
+			}
+		} else { // Minimum squared distance
+			for (unsigned int t = 0; t < dimensions; t++) {
+				double diff = point.at(t) - centroid[t];
+				value += diff * diff;
+			}
+		}
+
+		if (j == 0 || value < bestValue) {
+			bestValue = value;
+			best = j;
+		}
+	}
+
+	return best;
+}
+
+
+
+/* Read the whole file once assigning every point to the closest centroid.
+ * If collect is true, keep the IDs of the points of every cluster. Otherwise
+ * move the centroids to the means and return the largest squared movement */
+bool StreamingKMeans::pass(ThreadPool& pool, bool collect, double& movement) {
+	std::ifstream input(filename.c_str());
+	if (!input) {
+		return false;
+	}
+
+	// Every part of a chunk sums its points to its own part of the buffers
+	unsigned int k = numberOfClusters;
+	unsigned int parts = pool.size();
+	std::vector<double> partialSums((unsigned long) parts * k * dimensions, 0.0);
+	std::vector<unsigned long> partialCounts(parts * k, 0);
+	if (collect) {
+		clusters.assign(k, std::vector<std::string>());
+	}
+
+	std::vector<DataPoint> chunk;
+	std::vector<int> chunkClusters;
+	while (true) {
+		if (readChunk(input, chunk) == false) {
+			return false;
+		}
+		if (chunk.size() == 0) { // End of file
+			break;
+		}
+
+		chunkClusters.resize(chunk.size());
+		pool.parallelFor(parts, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int p = begin; p < end; p++) {
+				unsigned int first = (unsigned long) chunk.size() * p / parts;
+				unsigned int last = (unsigned long) chunk.size() * (p + 1) / parts;
+				for (unsigned int i = first; i < last; i++) {
+					int cluster = nearestCentroid(chunk[i]);
+					chunkClusters[i] = cluster;
+					if (collect) {
+						continue;
+					}
+
+					double *sum = &partialSums[((unsigned long) p * k + cluster) * dimensions];
+					// Sum the unit vectors for spherical K-means
+					double scale = (spherical && chunk[i].getNorm() > 0) ? 1 / chunk[i].getNorm() : 1.0;
+					for (unsigned int t = 0; t < dimensions; t++) {
+						sum[t] += chunk[i].at(t) * scale;
+					}
+					partialCounts[p * k + cluster]++;
+				}
+			}
+		});
+
+		if (collect) {
+			for (unsigned int i = 0; i < chunk.size(); i++) {
+				clusters[chunkClusters[i]].push_back(chunk[i].getID());
+			}
+		}
+	}
+	if (collect) {
+		return true;
+	}
+
+
+	// Move every centroid to the mean of its points (in order of the parts)
+	movement = 0.0;
+	std::vector<double> mean(dimensions);
+	for (unsigned int j = 0; j < k; j++) {
+		std::fill(mean.begin(), mean.end(), 0.0);
+		unsigned long count = 0;
+		for (unsigned int p = 0; p < parts; p++) {
+			const double *sum = &partialSums[((unsigned long) p * k + j) * dimensions];
+			for (unsigned int t = 0; t < dimensions; t++) {
+				mean[t] += sum[t];
+			}
+			count += partialCounts[p * k + j];
+		}
+		if (count == 0) { // Empty cluster: keep the previous centroid
+			continue;
+		}
+
+		if (spherical) {
+			normalizeRow(&mean[0], dimensions);
+		} else {
+			for (unsigned int t = 0; t < dimensions; t++) {
+				mean[t] /= count;
+			}
+		}
+
+		double *centroid = &centroids[j * dimensions];
+		double moved = 0.0;
+		for (unsigned int t = 0; t < dimensions; t++) {
+			moved += (mean[t] - centroid[t]) * (mean[t] - centroid[t]);
+			centroid[t] = mean[t];
+		}
+		if (moved > movement) {
+			movement = moved;
+		}
+	}
+
+	return true;
+}
+
+
+
+/* Return the number of passes (without the sampling and the final assignment) or -1 on error */
+int StreamingKMeans::run() {
+	// Find the initial centroids by clustering a sample
+	// (in a block so that the sample is freed before the passes)
+	{
+		std::vector<DataPoint> reservoir;
+		if (sample(reservoir) == false || reservoir.size() <= (unsigned int) numberOfClusters) {
+			return -1;
+		}
+
+		KMeansClustering *sampleClustering = spherical ? new SphericalKMeans(reservoir, numberOfClusters) : new KMeansClustering(reservoir, numberOfClusters);
+		sampleClustering->setInitialization(KMeansClustering::KMEANS_PP_INIT);
+		sampleClustering->setThreads(threads);
+		sampleClustering->setSeed(generator());
+		sampleClustering->run();
+
+		std::vector<DataPoint *> sampleCentroids = sampleClustering->getCentroids();
+		centroids.resize((unsigned long) numberOfClusters * dimensions);
+		for (int j = 0; j < numberOfClusters; j++) {
+			for (unsigned int t = 0; t < dimensions; t++) {
+				centroids[j * dimensions + t] = sampleCentroids[j]->at(t);
+			}
+			if (spherical) {
+				normalizeRow(&centroids[j * dimensions], dimensions);
+			}
+		}
+		delete sampleClustering;
+	}
+
+
+	ThreadPool pool(threads);
+	int passes = 0;
+	double movement = 0.0;
+	do {
+		if (pass(pool, false, movement) == false) {
+			return -1;
+		}
+		passes++;
+	} while (movement > tolerance && (unsigned int) passes < PASS_LIMIT);
+
+	// Assign every point to its closest centroid
+	if (pass(pool, true, movement) == false) {
+		return -1;
+	}
+
+	return passes;
+}
+
+
+
+/* Get the IDs of the points of each cluster */
+void StreamingKMeans::getPointsPerCluster(std::vector< std::vector<std::string> >& results) const {
+	results = clusters;
+}
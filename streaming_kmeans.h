@@ -0,0 +1,57 @@
+#ifndef STREAMING_KMEANS_H
+#define STREAMING_KMEANS_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <random>
+#include "data_point.h"
+#include "metrics.h"
+
+class ThreadPool;
+
+/* K-means over a file of points (same format as the processed tweets) that is read
+ * in chunks in every pass. Only one chunk, a sample of the points and the centroids
+ * are kept in memory, apart from the IDs of the members of every cluster */
+class StreamingKMeans {
+private:
+	static const unsigned int PASS_LIMIT = 20;
+	// The initial centroids are found by K-means on a sample of (factor * k) points
+	static const unsigned int SAMPLE_FACTOR = 50;
+
+	std::string filename;
+	int numberOfClusters;
+	bool spherical; // Cosine metric: K-means on unit vectors
+	unsigned int chunkSize;
+	unsigned int threads;
+	double tolerance; // Largest squared movement of a centroid to stop
+	std::default_random_engine generator;
+
+	unsigned int dimensions;
+	unsigned long numberOfPoints;
+	std::vector<double> centroids; // One row per centroid (row-major)
+	std::vector< std::vector<std::string> > clusters;
+
+
+	bool readChunk(std::ifstream&, std::vector<DataPoint>&) const;
+	bool sample(std::vector<DataPoint>&);
+	bool pass(ThreadPool&, bool, double&);
+	int nearestCentroid(const DataPoint&) const;
+public:
+	static const unsigned int DEFAULT_CHUNK_SIZE = 100000;
+
+	StreamingKMeans(const std::string&, int, int, unsigned int chunk = DEFAULT_CHUNK_SIZE);
+
+	// Number of threads used (every hardware thread if 0)
+	void setThreads(unsigned int threadsArg) { threads = threadsArg; }
+	void setTolerance(double toleranceArg) { tolerance = toleranceArg; }
+	// Seed of the sample and of its clustering (taken from the clock if not set)
+	void setSeed(unsigned int seed) { generator.seed(seed); }
+
+	int run();
+
+	unsigned long getNumberOfPoints() const { return numberOfPoints; }
+	void getPointsPerCluster(std::vector< std::vector<std::string> >&) const;
+};
+
+#endif // STREAMING_KMEANS_H
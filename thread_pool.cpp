@@ -0,0 +1,86 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <exception> // std::exception_ptr
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned int threads) : stopping(false) {
+	if (threads == 0) {
+		threads = std::thread::hardware_concurrency();
+		if (threads == 0) { // Unknown number of hardware threads
+			threads = 1;
+		}
+	}
+
+	for (unsigned int i = 0; i < threads; i++) {
+		workers.push_back(std::thread(&ThreadPool::work, this));
+	}
+}
+
+
+/* Execute tasks until the pool is destroyed */
+void ThreadPool::work() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (stopping && tasks.empty()) {
+				return;
+			}
+			task = tasks.front();
+			tasks.pop();
+		}
+		task();
+	}
+}
+
+
+void ThreadPool::parallelFor(unsigned int n, const std::function<void(unsigned int, unsigned int)>& f) {
+	if (n == 0) {
+		return;
+	}
+
+	// A few chunks per thread to balance uneven work
+	unsigned int chunks = workers.size() * 4;
+	if (chunks > n) {
+		chunks = n;
+	}
+	unsigned int chunkSize = (n + chunks - 1) / chunks;
+
+	std::vector< std::future<void> > results;
+	for (unsigned int begin = 0; begin < n; begin += chunkSize) {
+		unsigned int end = (begin + chunkSize < n) ? begin + chunkSize : n;
+		results.push_back(submit([&f, begin, end]() { f(begin, end); }));
+	}
+
+	// Wait for every chunk before rethrowing the first exception, as the chunks use f
+	std::exception_ptr error;
+	for (unsigned int i = 0; i < results.size(); i++) {
+		try {
+			results[i].get();
+		} catch (...) {
+			if (!error) {
+				error = std::current_exception();
+			}
+		}
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	for (unsigned int i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory> // std::make_shared
+
+/* Fixed number of worker threads executing the submitted tasks in FIFO order */
+class ThreadPool {
+private:
+	std::vector<std::thread> workers;
+	std::queue< std::function<void()> > tasks;
+	std::mutex queueMutex;
+	std::condition_variable condition;
+	bool stopping;
+
+
+	void work();
+public:
+	// Use every hardware thread if the number of threads is 0
+	ThreadPool(unsigned int threads = 0);
+
+	unsigned int size() const { return workers.size(); }
+
+	template<class F>
+	std::future<typename std::result_of<F()>::type> submit(F task);
+
+	// Split [0, n) in chunks and call f(begin, end) for every chunk in parallel.
+	// Must not be called from a task of the same pool
+	void parallelFor(unsigned int, const std::function<void(unsigned int, unsigned int)>&);
+
+	~ThreadPool();
+};
+
+
+/* Queue a task and return a future with its result */
+template<class F>
+std::future<typename std::result_of<F()>::type> ThreadPool::submit(F task) {
+	typedef typename std::result_of<F()>::type ResultType;
+	std::shared_ptr< std::packaged_task<ResultType()> > packaged = std::make_shared< std::packaged_task<ResultType()> >(task);
+	std::future<ResultType> result = packaged->get_future();
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		tasks.push([packaged]() { (*packaged)(); });
+	}
+	condition.notify_one();
+	return result;
+}
+
+#endif // THREAD_POOL_H
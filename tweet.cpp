@@ -13,7 +13,7 @@
 const double Tweet::SENTIMENT_NOT_SET = std::numeric_limits<double>::infinity();
 
 /* Read the tab-seperated tokens */
-bool Tweet::readTweet(const std::string& line) {
+bool Tweet::readTweet(const std::string& line, bool timed) {
 	// Check if '\r' is found which is used in Windows OS
 	if (line.find('\r') != std::string::npos) {
 		std::cerr << "[-] Windows format found" << std::endl;
@@ -51,6 +51,15 @@ bool Tweet::readTweet(const std::string& line) {
 	tweetID = (unsigned int) tempID;
 
 
+	// Read the time of the tweet
+	if (timed) {
+		if (!getline(lineStream, temp, delim) || !isNumber(temp)) {
+			return false;
+		}
+		time = atof(temp.c_str());
+	}
+
+
 	// Read the tokens
 	while (getline(lineStream, temp, delim)) {
 		tokens.push_back(temp);
@@ -11,12 +11,14 @@ private:
 	unsigned int userID;
 	std::vector<std::string> tokens;
 	std::vector<double> sentimentVector;
+	double time; // Used by the time-based sentiment aggregations
 public:
 	static const double SENTIMENT_NOT_SET;
 
-	Tweet() : tweetID(0), userID(0) {}
+	Tweet() : tweetID(0), userID(0), time(0.0) {}
 
-	bool readTweet(const std::string&);
+	// With timed the third column is the time of the tweet (in any unit, e.g. seconds)
+	bool readTweet(const std::string&, bool timed = false);
 	void calculateSentiments(const std::unordered_map<std::string, double>&, double alpha, const std::vector< std::vector<std::string> >&);
 
 	unsigned int getID() const { return tweetID; }
@@ -24,6 +26,7 @@ public:
 	unsigned int getSize() const { return tokens.size(); }
 	std::vector<std::string> getTokens() const { return tokens; }
 	std::vector<double> getSentiment() const { return sentimentVector; }
+	double getTime() const { return time; }
 };
 
 #endif // TWEET_H